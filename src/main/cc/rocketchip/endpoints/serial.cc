@@ -8,8 +8,10 @@ serial_t::serial_t(simif_t* sim, fesvr_proxy_t* fesvr):
 }
 
 void serial_t::tick() {
+  MMIO_PROFILE_PHASE(MMIO_PHASE_SERIAL);
   data.out.ready = true;
-  data.out.valid = read(SERIALWIDGET_0(out_valid));
+  // Pending only while the target output waits for us
+  data.out.valid = status(SERIALWIDGET_0(PENDING_BIT));
   if (data.out.fire()) {
     data.out.bits = read(SERIALWIDGET_0(out_bits));
     write(SERIALWIDGET_0(out_ready), data.out.ready);
@@ -22,6 +24,7 @@ void serial_t::tick() {
 }
 
 void serial_t::work() {
+  MMIO_PROFILE_PHASE(MMIO_PHASE_SERIAL);
   do {
     data.in.valid = fesvr->data_available();
     data.in.ready = data.in.valid ? read(SERIALWIDGET_0(in_ready)) : false;
@@ -29,7 +29,7 @@ public:
   void work();
   virtual void init(int argc, char** argv) { }
   virtual void tick();
-  virtual bool done() { return fesvr->done() || read(SERIALWIDGET_0(done)); }
+  virtual bool done() { return fesvr->done() || status(SERIALWIDGET_0(DONE_BIT)); }
 
 private:
   serial_data_t<uint32_t> data;
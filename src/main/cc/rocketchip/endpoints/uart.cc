@@ -26,6 +26,7 @@ void sighand(int s) {
 
 uart_t::uart_t(simif_t* sim): endpoint_t(sim)
 {
+    data.in.valid = false;
 #ifndef _WIN32
     // Don't block on stdin reads if there is nothing typed in
     fcntl(STDIN_FILENO, F_SETFL, fcntl(STDIN_FILENO, F_GETFL) | O_NONBLOCK);
@@ -57,32 +58,40 @@ void uart_t::recv() {
   }
 }
 
-void uart_t::tick() {
-  data.out.ready = true;
-  data.in.valid = false;
-  do {
-    this->recv();
-
+// Buffers a character from stdin (or a pending special character)
+// until the widget accepts it
+bool uart_t::read_input() {
 #ifndef _WIN32
-    if (data.in.ready) {
-        char inp;
-        int readamt;
-        if (specialchar) {
-            // send special character (e.g. ctrl-c)
-            inp = specialchar;
-            specialchar = 0;
-            readamt = 1;
-        } else {
-            // else check if we have input on stdin
-            readamt = ::read(STDIN_FILENO, &inp, 1);
-        }
+  if (!data.in.valid) {
+    char inp;
+    int readamt;
+    if (specialchar) {
+      // send special character (e.g. ctrl-c)
+      inp = specialchar;
+      specialchar = 0;
+      readamt = 1;
+    } else {
+      // else check if we have input on stdin
+      readamt = ::read(STDIN_FILENO, &inp, 1);
+    }
 
-        if (readamt > 0) {
-            data.in.bits = inp;
-            data.in.valid = true;
-        }
+    if (readamt > 0) {
+      data.in.bits = inp;
+      data.in.valid = true;
     }
+  }
 #endif
+  return data.in.valid;
+}
+
+void uart_t::tick() {
+  MMIO_PROFILE_PHASE(MMIO_PHASE_UART);
+  data.out.ready = true;
+  // Nothing to do unless the widget has output or there is input for it
+  if (!status(UARTWIDGET_0(PENDING_BIT)) && !read_input()) return;
+  do {
+    this->recv();
+    if (data.in.ready) read_input();
 
     if (data.out.fire()) {
       fprintf(stdout, "%c", data.out.bits);
@@ -91,6 +100,6 @@ void uart_t::tick() {
     }
 
     this->send();
-    data.in.valid = false;
+    if (data.in.fire()) data.in.valid = false;
   } while(data.in.fire() || data.out.fire());
 }
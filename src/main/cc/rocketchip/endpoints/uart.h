@@ -14,9 +14,11 @@ public:
   void recv();
   virtual void init(int argc, char** argv) { }
   virtual void tick();
-  virtual bool done() { return read(UARTWIDGET_0(done)); }
+  virtual bool done() { return status(UARTWIDGET_0(DONE_BIT)); }
 
 private:
+  bool read_input();
+
   serial_data_t<char> data;
 };
 
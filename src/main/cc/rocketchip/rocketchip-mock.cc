@@ -0,0 +1,63 @@
+// See LICENSE for license details.
+
+#include <deque>
+
+#include "simif_mock.h"
+#include "rocketchip.h"
+#include "fesvr/fesvr_proxy.h"
+
+// Stands in for fesvr, as the mock target runs no program that a real
+// front-end server could talk to. Every serial word from the target is
+// answered with one word back, so both directions of the serial endpoint
+// stay busy, and the run ends after +mock-cycles target cycles.
+class mock_fesvr_t: public fesvr_proxy_t
+{
+public:
+  mock_fesvr_t(const std::vector<std::string>& args): sim(NULL), end_cycle(-1ULL) {
+    for (auto &arg: args) {
+      if (arg.find("+mock-cycles=") == 0) {
+        end_cycle = strtoull(arg.c_str() + 13, NULL, 10);
+      }
+    }
+  }
+  void attach(simif_t* s) { sim = s; }
+
+  virtual bool recv_loadmem_req(fesvr_loadmem_t& req) { return false; }
+  virtual void recv_loadmem_data(void* buf, size_t len) { }
+
+  virtual bool data_available() { return !replies.empty(); }
+  virtual uint32_t recv_word() {
+    uint32_t word = replies.front();
+    replies.pop_front();
+    return word;
+  }
+  virtual void send_word(uint32_t word) { replies.push_back(word); }
+
+  virtual void tick() { }
+  virtual bool busy() { return false; }
+  virtual bool done() { return sim && sim->cycles() >= end_cycle; }
+  virtual int exit_code() { return 0; }
+
+private:
+  simif_t* sim;
+  uint64_t end_cycle;
+  std::deque<uint32_t> replies;
+};
+
+class rocketchip_mock_t:
+  public simif_mock_t,
+  public rocketchip_t
+{
+public:
+  rocketchip_mock_t(int argc, char** argv, fesvr_proxy_t* fesvr):
+    rocketchip_t(argc, argv, fesvr) { }
+};
+
+int main(int argc, char** argv) {
+  mock_fesvr_t fesvr(std::vector<std::string>(argv + 1, argv + argc));
+  rocketchip_mock_t rocketchip(argc, argv, &fesvr);
+  fesvr.attach(&rocketchip);
+  rocketchip.init(argc, argv);
+  rocketchip.run(1024 * 1000);
+  return rocketchip.finish();
+}
@@ -2,6 +2,7 @@
 
 #include "rocketchip.h"
 #include "endpoints/uart.h"
+#include "endpoints/sim_mem.h"
 
 rocketchip_t::rocketchip_t(int argc, char** argv, fesvr_proxy_t* fesvr): fesvr(fesvr)
 {
@@ -23,6 +24,7 @@ rocketchip_t::rocketchip_t(int argc, char** argv, fesvr_proxy_t* fesvr): fesvr(f
 }
 
 void rocketchip_t::loadmem() {
+  MMIO_PROFILE_PHASE(MMIO_PHASE_LOADMEM);
   fesvr_loadmem_t loadmem; 
   while (fesvr->recv_loadmem_req(loadmem)) {
     assert(loadmem.size <= 1024);
@@ -31,16 +33,12 @@ void rocketchip_t::loadmem() {
 #ifdef LOADMEM
     const size_t mem_data_bytes = MEM_DATA_CHUNK * sizeof(data_t);
 #define WRITE_MEM(addr, src) \
-    mpz_t data; \
-    mpz_init(data); \
-    mpz_import(data, mem_data_bytes / sizeof(uint32_t), -1, sizeof(uint32_t), 0, 0, src); \
-    write_mem(addr, data); \
-    mpz_clear(data);
+    write_mem(addr, mem_bits_t(src, mem_data_bytes));
 #else
     const size_t mem_data_bytes = MEM_DATA_BITS / 8;
 #define WRITE_MEM(addr, src) \
     for (auto e: endpoints) { \
-      if (sim_mem_t* s = dynamic_cast<sim_mem_t*>(e)) { \
+      if (sim_mem_channels_t* s = dynamic_cast<sim_mem_channels_t*>(e)) { \
         s->write_mem(addr, src); \
       } \
     }
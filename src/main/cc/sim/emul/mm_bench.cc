@@ -0,0 +1,115 @@
+// See LICENSE for license details.
+
+#include "mm.h"
+#include "mm_dramsim2.h"
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <stdint.h>
+#include <time.h>
+
+// Runs the same read traces through each memory timing model and reports
+// the mean load-to-use latency in cycles and the host cost per tick, to
+// check the analytical DDR3 model against DRAMSim2. Run from the output
+// directory so both models find dramsim2_ini. The sparse trace leaves the
+// memory idle between reads, as a compute-bound target does, and is also
+// run on DRAMSim2 with idle fast-forward (+dramsim-idle-skip) to check it.
+// The DDR3 model is always run here, though +ddr3 only selects it in
+// builds with MM_DDR3=1 until this comparison has been made.
+//   usage: <DESIGN>-mm-bench [requests] [outstanding]
+
+static const size_t LINE_SIZE = 64;
+static const size_t MEM_SIZE = 1L << 30;
+static const size_t SPARSE_GAP = 100000;
+
+static inline uint64_t now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return 1000000000ULL * ts.tv_sec + ts.tv_nsec;
+}
+
+enum pattern_t { SEQUENTIAL, STRIDED, RANDOM, SPARSE };
+
+// Address of the i-th request
+static uint64_t trace_addr(pattern_t pattern, uint64_t i) {
+  switch (pattern) {
+    case SEQUENTIAL: return i * LINE_SIZE;
+    // A new row every access
+    case STRIDED: return (i * (1 << 20)) % MEM_SIZE;
+    default:
+      i = (i ^ (i >> 30)) * 0xbf58476d1ce4e5b9ULL;
+      i = (i ^ (i >> 27)) * 0x94d049bb133111ebULL;
+      return (i ^ (i >> 31)) % (MEM_SIZE / LINE_SIZE) * LINE_SIZE;
+  }
+}
+
+static void bench(mm_t* mem, pattern_t pattern, size_t requests, size_t outstanding,
+                  double* latency, double* host_ns) {
+  mem->init(MEM_SIZE, MEM_WIDTH, LINE_SIZE);
+  const size_t beats = LINE_SIZE / MEM_WIDTH;
+  std::deque<uint64_t> issued;
+  uint64_t cycle = 0, total = 0;
+  uint64_t next_issue = 0;
+  size_t sent = 0, done = 0;
+  const uint64_t start = now();
+  while (done < requests) {
+    const bool ar_valid = sent < requests && issued.size() < outstanding &&
+                          cycle >= next_issue;
+    const bool ar_fire = ar_valid && mem->ar_ready();
+    const bool r_last = mem->r_valid() && mem->r_last();
+    mem->tick(false,
+      ar_valid, trace_addr(pattern, sent), 0, 3, beats - 1,
+      false, 0, 0, 0, 0,
+      false, 0, NULL, false,
+      true, true);
+    if (ar_fire) {
+      issued.push_back(cycle);
+      sent++;
+      if (pattern == SPARSE) next_issue = cycle + SPARSE_GAP;
+    }
+    if (r_last) {
+      total += cycle - issued.front();
+      issued.pop_front();
+      done++;
+    }
+    cycle++;
+  }
+  *latency = (double)total / requests;
+  *host_ns = (double)(now() - start) / cycle;
+}
+
+int main(int argc, char** argv) {
+  size_t requests = argc > 1 ? strtoll(argv[1], NULL, 10) : 100000;
+  size_t outstanding = argc > 2 ? strtoll(argv[2], NULL, 10) : 4;
+  struct { const char* name; mm_model_t model; } models[] = {
+    { "magic", MM_MODEL_MAGIC },
+    { "dramsim2", MM_MODEL_DRAMSIM2 },
+    { "ddr3", MM_MODEL_DDR3 },
+    { "latency-pipe", MM_MODEL_LATENCY_PIPE },
+  };
+  struct { const char* name; pattern_t pattern; } patterns[] = {
+    { "sequential", SEQUENTIAL },
+    { "strided", STRIDED },
+    { "random", RANDOM },
+    { "sparse", SPARSE },
+  };
+  printf("%-10s %-12s %14s %12s\n", "pattern", "model", "latency (cyc)", "tick (ns)");
+  for (auto& pattern: patterns) {
+    // Keep the sparse trace to a similar number of cycles
+    const size_t n = pattern.pattern == SPARSE ? requests / 500 + 1 : requests;
+    double latency, host_ns;
+    for (auto& model: models) {
+      mm_t* mem = mm_new(model.model);
+      bench(mem, pattern.pattern, n, outstanding, &latency, &host_ns);
+      printf("%-10s %-12s %14.2f %12.2f\n", pattern.name, model.name, latency, host_ns);
+      delete mem;
+    }
+    if (pattern.pattern == SPARSE) {
+      mm_dramsim2_t mem;
+      mem.set_idle_skip(true);
+      bench(&mem, pattern.pattern, n, outstanding, &latency, &host_ns);
+      printf("%-10s %-12s %14.2f %12.2f\n", pattern.name, "dramsim2-skip", latency, host_ns);
+    }
+  }
+  return 0;
+}
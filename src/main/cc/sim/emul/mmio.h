@@ -5,6 +5,11 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include "mm.h"
+
+// Control-bus reads the emulated master keeps in flight. Writes stay one at
+// a time, as the widget interconnect routes W beats by the last AW.
+#define MMIO_MAX_READS 8
 
 class mmio_t
 {
@@ -15,6 +20,8 @@ public:
   virtual bool write_resp() = 0;
 };
 
-void* init(uint64_t memsize, bool dram);
+// image, if not empty, is a saved store to map instead of a zeroed one
+mm_t* init(uint64_t memsize, mm_model_t model, mm_pages_t pages,
+           const std::string& image);
 
 #endif // __MMIO_H
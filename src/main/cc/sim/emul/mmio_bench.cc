@@ -0,0 +1,89 @@
+// See LICENSE for license details.
+
+#include "mmio_queue.h"
+#include <cstdio>
+#include <cstdlib>
+#include <queue>
+#include <stdint.h>
+#include <time.h>
+
+// Host cost of the emulated bus plumbing per cycle: each cycle one request
+// is queued and one data beat lands on the R channel, and every burst is
+// drained the way read_resp does. The old std::queue scheme with a heap
+// copy per beat runs alongside for comparison.
+//   usage: <DESIGN>-mmio-bench [cycles]
+
+struct req_t {
+  size_t id;
+  uint64_t addr;
+  size_t size;
+  size_t len;
+};
+
+struct resp_t {
+  size_t id;
+  char* data;
+  bool last;
+};
+
+static inline uint64_t now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return 1000000000ULL * ts.tv_sec + ts.tv_nsec;
+}
+
+static double bench_queue(size_t width, size_t cycles, size_t burst) {
+  mmio_queue_t<req_t> ar;
+  mmio_beat_queue_t r(width);
+  std::vector<char> beat(width, 1), dst(width * burst);
+  uint64_t start = now();
+  for (size_t c = 0 ; c < cycles ; c++) {
+    ar.push(req_t { 0, c, 0, burst - 1 });
+    r.push(0, &beat[0], (c + 1) % burst == 0);
+    if (r.size() == burst) {
+      for (size_t i = 0 ; i < burst ; i++) {
+        memcpy(&dst[i * width], r.front_data(), width);
+        r.pop();
+      }
+    }
+    ar.pop();
+  }
+  return (double)(now() - start) / cycles;
+}
+
+static double bench_std(size_t width, size_t cycles, size_t burst) {
+  std::queue<req_t> ar;
+  std::queue<resp_t> r;
+  std::vector<char> beat(width, 1), dst(width * burst);
+  uint64_t start = now();
+  for (size_t c = 0 ; c < cycles ; c++) {
+    ar.push(req_t { 0, c, 0, burst - 1 });
+    char* data = (char*)malloc(width);
+    memcpy(data, &beat[0], width);
+    r.push(resp_t { 0, data, (c + 1) % burst == 0 });
+    if (r.size() == burst) {
+      for (size_t i = 0 ; i < burst ; i++) {
+        memcpy(&dst[i * width], r.front().data, width);
+        free(r.front().data);
+        r.pop();
+      }
+    }
+    ar.pop();
+  }
+  return (double)(now() - start) / cycles;
+}
+
+int main(int argc, char** argv) {
+  size_t cycles = argc > 1 ? strtoll(argv[1], NULL, 10) : 10000000;
+  struct { const char* name; size_t width; size_t burst; } ports[] = {
+    { "master", MMIO_WIDTH, 1 },
+    { "dma", DMA_WIDTH, 256 },
+  };
+  printf("%-8s %6s %6s %12s %12s\n", "port", "width", "burst", "ring (ns)", "std (ns)");
+  for (auto& port: ports) {
+    printf("%-8s %6zu %6zu %12.2f %12.2f\n", port.name, port.width, port.burst,
+      bench_queue(port.width, cycles, port.burst),
+      bench_std(port.width, cycles, port.burst));
+  }
+  return 0;
+}
@@ -15,14 +15,15 @@
 #endif
 
 void mmio_f1_t::read_req(uint64_t addr, size_t size, size_t len) {
-  mmio_req_addr_t ar(0, addr, size, len);
+  // Requests go out in order, so the ids in flight are always distinct
+  mmio_req_addr_t ar(read_id++ % max_reads, addr, size, len);
   this->ar.push(ar);
 }
 
 void mmio_f1_t::write_req(uint64_t addr, size_t size, size_t len, void* data, size_t *strb) {
   int nbytes = 1 << size;
 
-  mmio_req_addr_t aw(0, addr, size, len);
+  mmio_req_addr_t aw(write_id++ % max_writes, addr, size, len);
   this->aw.push(aw);
 
   for (int i = 0; i < len + 1; i++) {
@@ -49,46 +50,48 @@ void mmio_f1_t::tick(
   const bool r_fire = !reset && r_valid && r_ready();
   const bool b_fire = !reset && b_valid && b_ready();
 
-  if (ar_fire) read_inflight = true;
-  if (aw_fire) write_inflight = true;
+  if (ar_fire) {
+    ar_inflight.push(ar.front());
+    ar.pop();
+  }
+  if (aw_fire) {
+    aw_inflight.push(aw.front());
+    aw.pop();
+  }
   if (w_fire) this->w.pop();
   if (r_fire) {
-    char* dat = (char*)malloc(dummy_data.size());
-    memcpy(dat, (char*)r_data, dummy_data.size());
-    mmio_resp_data_t r(r_id, dat, r_last);
-    this->r.push(r);
+    assert(r_id < max_reads);
+    this->r[r_id].push(r_id, r_data, r_last);
   }
   if (b_fire) {
-    this->b.push(b_id);
+    assert(b_id < max_writes);
+    this->b[b_id]++;
   }
 }
 
 bool mmio_f1_t::read_resp(void* data) {
-  if (ar.empty() || r.size() <= ar.front().len) {
+  if (ar_inflight.empty() || r[ar_inflight.front().id].size() <= ar_inflight.front().len) {
     return false;
   } else {
-    auto ar = this->ar.front();
+    auto ar = ar_inflight.front();
+    auto& r = this->r[ar.id];
     size_t word_size = 1 << ar.size;
     for (size_t i = 0 ; i <= ar.len ; i++) {
-      auto r = this->r.front();
-      assert(i < ar.len || r.last);
-      memcpy(((char*)data) + i * word_size, r.data, word_size);
-      free(r.data);
-      this->r.pop();
+      assert(i < ar.len || r.front_last());
+      memcpy(((char*)data) + i * word_size, r.front_data(), word_size);
+      r.pop();
     }
-    this->ar.pop();
-    read_inflight = false;
+    ar_inflight.pop();
     return true;
   }
 }
 
 bool mmio_f1_t::write_resp() {
-  if (aw.empty() || b.empty()) {
+  if (aw_inflight.empty() || !b[aw_inflight.front().id]) {
     return false;
   } else {
-    aw.pop();
-    b.pop();
-    write_inflight = false;
+    b[aw_inflight.front().id]--;
+    aw_inflight.pop();
     return true;
   }
 }
@@ -97,13 +100,19 @@ extern uint64_t main_time;
 extern std::unique_ptr<mmio_t> master;
 extern std::unique_ptr<mmio_t> dma;
 std::unique_ptr<mm_t> slave;
-
-void* init(uint64_t memsize, bool dramsim) {
-  master.reset(new mmio_f1_t(MMIO_WIDTH));
-  dma.reset(new mmio_f1_t(DMA_WIDTH));
-  slave.reset(dramsim ? (mm_t*) new mm_dramsim2_t : (mm_t*) new mm_magic_t);
+// The same ports as master and dma, typed for the per-cycle glue below
+static mmio_f1_t* master_port = NULL;
+static mmio_f1_t* dma_port = NULL;
+
+mm_t* init(uint64_t memsize, mm_model_t model, mm_pages_t pages,
+           const std::string& image) {
+  master.reset(master_port = new mmio_f1_t(MMIO_WIDTH, MMIO_MAX_READS));
+  dma.reset(dma_port = new mmio_f1_t(DMA_WIDTH));
+  slave.reset(mm_new(model));
+  slave->set_pages(pages);
+  if (!image.empty()) slave->set_image(image);
   slave->init(memsize, MEM_WIDTH, 64);
-  return slave->get_data();
+  return slave.get();
 }
 
 #ifdef VCS
@@ -215,9 +224,8 @@ void tick(
   vc_handle slave_b_bits_resp,
   vc_handle slave_b_bits_id
 ) {
-  mmio_f1_t *m, *d;
-  assert(m = dynamic_cast<mmio_f1_t*>(master.get()));
-  assert(d = dynamic_cast<mmio_f1_t*>(dma.get()));
+  mmio_f1_t* const m = master_port;
+  mmio_f1_t* const d = dma_port;
   assert(DMA_STRB_SIZE <= 2);
 
   uint32_t master_r_data[MASTER_DATA_SIZE];
@@ -413,9 +421,8 @@ extern VerilatedVcdC* tfp;
 #endif // VM_TRACE
 
 void tick() {
-  mmio_f1_t *m, *d;
-  assert(m = dynamic_cast<mmio_f1_t*>(master.get()));
-  assert(d = dynamic_cast<mmio_f1_t*>(dma.get()));
+  mmio_f1_t* const m = master_port;
+  mmio_f1_t* const d = dma_port;
   top->clock = 1;
   top->eval();
 #if VM_TRACE
@@ -482,10 +489,10 @@ void tick() {
 
   top->io_dma_r_ready = d->r_ready();
   top->io_dma_b_ready = d->b_ready();
-#if CTRL_DATA_BITS > 64
-  memcpy(top->io_dma_w_bits_data, d->w_data(), MMIO_WIDTH);
+#if DMA_DATA_BITS > 64
+  memcpy(top->io_dma_w_bits_data, d->w_data(), DMA_WIDTH);
 #else
-  memcpy(&top->io_dma_w_bits_data, d->w_data(), MMIO_WIDTH);
+  memcpy(&top->io_dma_w_bits_data, d->w_data(), DMA_WIDTH);
 #endif
 
   d->tick(
@@ -494,7 +501,7 @@ void tick() {
     top->io_dma_aw_ready,
     top->io_dma_w_ready,
     top->io_dma_r_bits_id,
-#if CTRL_DATA_BITS > 64
+#if DMA_DATA_BITS > 64
     top->io_dma_r_bits_data,
 #else
     &top->io_dma_r_bits_data,
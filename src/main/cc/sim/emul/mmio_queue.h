@@ -0,0 +1,102 @@
+// See LICENSE for license details.
+
+#ifndef __MMIO_QUEUE_H
+#define __MMIO_QUEUE_H
+
+#include <cstring>
+#include <stddef.h>
+#include <vector>
+
+// FIFOs for the AXI channels of the emulated bus models. Both sit on a
+// power-of-two ring that only allocates when it has to grow, so a bus in
+// steady state does no heap traffic per request or per beat.
+
+template <typename T>
+class mmio_queue_t
+{
+public:
+  mmio_queue_t(size_t capacity = 16): slots(pow2(capacity)), head(0), tail(0) { }
+
+  inline bool empty() const { return head == tail; }
+  inline size_t size() const { return tail - head; }
+  inline size_t capacity() const { return slots.size(); }
+  inline T& front() { return slots[head & (slots.size() - 1)]; }
+  inline T& back() { return slots[(tail - 1) & (slots.size() - 1)]; }
+  inline void pop() { head++; }
+  inline void push(const T& x) {
+    if (size() == slots.size()) grow();
+    slots[tail++ & (slots.size() - 1)] = x;
+  }
+
+private:
+  std::vector<T> slots;
+  size_t head;
+  size_t tail;
+
+  static size_t pow2(size_t n) {
+    size_t p = 1;
+    while (p < n) p <<= 1;
+    return p;
+  }
+  void grow() {
+    std::vector<T> bigger(slots.size() * 2);
+    for (size_t i = 0 ; i < size() ; i++) {
+      bigger[i] = slots[(head + i) & (slots.size() - 1)];
+    }
+    tail = size();
+    head = 0;
+    slots.swap(bigger);
+  }
+};
+
+// Data beats of a fixed width, copied into the ring itself
+class mmio_beat_queue_t
+{
+public:
+  // 256 beats covers the longest AXI burst
+  mmio_beat_queue_t(size_t width, size_t capacity = 256):
+    width(width), beats(capacity), data(beats.capacity() * width) { }
+
+  inline bool empty() const { return beats.empty(); }
+  inline size_t size() const { return beats.size(); }
+  inline size_t front_id() { return beats.front().id; }
+  inline bool front_last() { return beats.front().last; }
+  inline const char* front_data() { return &data[beats.front().slot * width]; }
+  inline void pop() { beats.pop(); }
+  inline void push(size_t id, const void* src, bool last) {
+    if (beats.size() == beats.capacity()) grow();
+    // Beats keep the data slot they were given when the ring was last resized
+    const size_t slot = beats.empty() ? 0 :
+      (beats.back().slot + 1) & (beats.capacity() - 1);
+    beats.push(beat_t { id, last, slot });
+    memcpy(&data[slot * width], src, width);
+  }
+
+private:
+  struct beat_t {
+    size_t id;
+    bool last;
+    size_t slot;
+  };
+
+  const size_t width;
+  mmio_queue_t<beat_t> beats;
+  std::vector<char> data;
+
+  void grow() {
+    // Compacts the data into slots 0..size-1 of a ring twice the size
+    std::vector<char> bigger(data.size() * 2);
+    mmio_queue_t<beat_t> moved(beats.capacity() * 2);
+    for (size_t i = 0 ; !beats.empty() ; i++) {
+      beat_t beat = beats.front();
+      memcpy(&bigger[i * width], &data[beat.slot * width], width);
+      beat.slot = i;
+      moved.push(beat);
+      beats.pop();
+    }
+    beats = moved;
+    data.swap(bigger);
+  }
+};
+
+#endif // __MMIO_QUEUE_H
@@ -17,14 +17,15 @@
 #endif
 
 void mmio_zynq_t::read_req(uint64_t addr, size_t size, size_t len) {
-  mmio_req_addr_t ar(0, addr, size, len);
+  // Requests go out in order, so the ids in flight are always distinct
+  mmio_req_addr_t ar(read_id++ % max_reads, addr, size, len);
   this->ar.push(ar);
 }
 
 void mmio_zynq_t::write_req(uint64_t addr, size_t size, size_t len, void* data, size_t *strb) {
   int nbytes = 1 << size;
 
-  mmio_req_addr_t aw(0, addr, size, len);
+  mmio_req_addr_t aw(write_id++ % max_writes, addr, size, len);
   this->aw.push(aw);
 
   for (int i = 0; i < len + 1; i++) {
@@ -51,47 +52,48 @@ void mmio_zynq_t::tick(
   const bool r_fire = !reset && r_valid && r_ready();
   const bool b_fire = !reset && b_valid && b_ready();
 
-  if (ar_fire) read_inflight = true;
-  if (aw_fire) write_inflight = true;
+  if (ar_fire) {
+    ar_inflight.push(ar.front());
+    ar.pop();
+  }
+  if (aw_fire) {
+    aw_inflight.push(aw.front());
+    aw.pop();
+  }
   if (w_fire) this->w.pop();
   if (r_fire) {
-    char* dat = (char*)malloc(dummy_data.size());
-    memcpy(dat, (char*)r_data, dummy_data.size());
-    mmio_resp_data_t r(r_id, dat, r_last);
-    this->r.push(r);
+    assert(r_id < max_reads);
+    this->r[r_id].push(r_id, r_data, r_last);
   }
   if (b_fire) {
-    this->b.push(b_id);
+    assert(b_id < max_writes);
+    this->b[b_id]++;
   }
 }
 
 bool mmio_zynq_t::read_resp(void* data) {
-  if (ar.empty() || r.size() <= ar.front().len) {
+  if (ar_inflight.empty() || r[ar_inflight.front().id].size() <= ar_inflight.front().len) {
     return false;
   } else {
-    auto ar = this->ar.front();
+    auto ar = ar_inflight.front();
+    auto& r = this->r[ar.id];
     size_t word_size = 1 << ar.size;
     for (size_t i = 0 ; i <= ar.len ; i++) {
-      auto r = this->r.front();
-      assert(ar.id == r.id && (i < ar.len || r.last));
-      memcpy(((char*)data) + i * word_size, r.data, word_size);
-      free(r.data);
-      this->r.pop();
+      assert(ar.id == r.front_id() && (i < ar.len || r.front_last()));
+      memcpy(((char*)data) + i * word_size, r.front_data(), word_size);
+      r.pop();
     }
-    this->ar.pop();
-    read_inflight = false;
+    ar_inflight.pop();
     return true;
   }
 }
 
 bool mmio_zynq_t::write_resp() {
-  if (aw.empty() || b.empty()) {
+  if (aw_inflight.empty() || !b[aw_inflight.front().id]) {
     return false;
   } else {
-    assert(aw.front().id == b.front());
-    aw.pop();
-    b.pop();
-    write_inflight = false;
+    b[aw_inflight.front().id]--;
+    aw_inflight.pop();
     return true;
   }
 }
@@ -99,12 +101,17 @@ bool mmio_zynq_t::write_resp() {
 extern uint64_t main_time;
 extern std::unique_ptr<mmio_t> master;
 std::unique_ptr<mm_t> slave;
-
-void* init(uint64_t memsize, bool dramsim) {
-  master.reset(new mmio_zynq_t);
-  slave.reset(dramsim ? (mm_t*) new mm_dramsim2_t : (mm_t*) new mm_magic_t);
+// The same port as master, typed for the per-cycle glue below
+static mmio_zynq_t* master_port = NULL;
+
+mm_t* init(uint64_t memsize, mm_model_t model, mm_pages_t pages,
+           const std::string& image) {
+  master.reset(master_port = new mmio_zynq_t(MMIO_MAX_READS));
+  slave.reset(mm_new(model));
+  slave->set_pages(pages);
+  if (!image.empty()) slave->set_image(image);
   slave->init(memsize, MEM_WIDTH, 64);
-  return slave->get_data();
+  return slave.get();
 }
 
 #ifdef VCS
@@ -182,8 +189,7 @@ void tick(
   vc_handle slave_b_bits_resp,
   vc_handle slave_b_bits_id
 ) {
-  mmio_zynq_t* m;
-  assert(m = dynamic_cast<mmio_zynq_t*>(master.get()));
+  mmio_zynq_t* const m = master_port;
   uint32_t master_r_data[MASTER_DATA_SIZE];
   for (size_t i = 0 ; i < MASTER_DATA_SIZE ; i++) {
     master_r_data[i] = vc_4stVectorRef(master_r_bits_data)[i].d;
@@ -314,8 +320,7 @@ extern VerilatedVcdC* tfp;
 #endif // VM_TRACE
 
 void tick() {
-  mmio_zynq_t* m;
-  assert(m = dynamic_cast<mmio_zynq_t*>(master.get()));
+  mmio_zynq_t* const m = master_port;
   top->clock = 1;
   top->eval();
 #if VM_TRACE
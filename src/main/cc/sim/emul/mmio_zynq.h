@@ -4,9 +4,9 @@
 #define __MMIO_ZYNQ_H
 
 #include "mmio.h"
+#include "mmio_queue.h"
 #include <cstring>
 #include <vector>
-#include <queue>
 
 struct mmio_req_addr_t
 {
@@ -17,6 +17,7 @@ struct mmio_req_addr_t
 
   mmio_req_addr_t(size_t id_, uint64_t addr_, size_t size_, size_t len_):
     id(id_), addr(addr_), size(size_), len(len_) { }
+  mmio_req_addr_t() { }
 };
 
 struct mmio_req_data_t
@@ -27,32 +28,27 @@ struct mmio_req_data_t
   
   mmio_req_data_t(char* data_, size_t strb_, bool last_):
     data(data_), strb(strb_), last(last_) { }
-};
-
-struct mmio_resp_data_t
-{
-  size_t id;
-  char* data;
-  bool last;
-
-  mmio_resp_data_t(size_t id_, char* data_, bool last_):
-    id(id_), data(data_), last(last_) { }
+  mmio_req_data_t() { }
 };
 
 class mmio_zynq_t: public mmio_t
 {
 public:
-  mmio_zynq_t(): read_inflight(false), write_inflight(false) {
+  // Up to max_reads reads and max_writes writes are outstanding at once,
+  // each on its own AXI id
+  mmio_zynq_t(size_t max_reads = 1, size_t max_writes = 1):
+    max_reads(max_reads), max_writes(max_writes), read_id(0), write_id(0),
+    r(max_reads, mmio_beat_queue_t(MMIO_WIDTH)), b(max_writes, 0) {
     dummy_data.resize(MMIO_WIDTH);
   }
 
-  bool aw_valid() { return !aw.empty() && !write_inflight; }
+  bool aw_valid() { return !aw.empty() && aw_inflight.size() < max_writes; }
   size_t aw_id() { return aw_valid() ? aw.front().id : 0; }
   uint64_t aw_addr() { return aw_valid() ? aw.front().addr : 0; }
   size_t aw_size() { return aw_valid() ? aw.front().size : 0; }
   size_t aw_len() { return aw_valid() ? aw.front().len : 0; }
 
-  bool ar_valid() { return !ar.empty() && !read_inflight; }
+  bool ar_valid() { return !ar.empty() && ar_inflight.size() < max_reads; }
   size_t ar_id() { return ar_valid() ? ar.front().id : 0; }
   uint64_t ar_addr() { return ar_valid() ? ar.front().addr : 0; }
   size_t ar_size() { return ar_valid() ? ar.front().size : 0; }
@@ -63,8 +59,8 @@ public:
   bool w_last() { return w_valid() ? w.front().last : false; }
   void* w_data() { return w_valid() ? w.front().data : &dummy_data[0]; }
 
-  bool r_ready() { return read_inflight; }
-  bool b_ready() { return write_inflight; }
+  bool r_ready() { return !ar_inflight.empty(); }
+  bool b_ready() { return !aw_inflight.empty(); }
 
   void tick
   (
@@ -86,14 +82,21 @@ public:
   virtual bool write_resp();
 
 private:
-  std::queue<mmio_req_addr_t> ar;
-  std::queue<mmio_req_addr_t> aw;
-  std::queue<mmio_req_data_t> w;
-  std::queue<mmio_resp_data_t> r;
-  std::queue<size_t> b;
-
-  bool read_inflight;
-  bool write_inflight;
+  const size_t max_reads;
+  const size_t max_writes;
+  size_t read_id;
+  size_t write_id;
+
+  // Requests wait in ar/aw until issued, then in *_inflight until answered
+  mmio_queue_t<mmio_req_addr_t> ar;
+  mmio_queue_t<mmio_req_addr_t> ar_inflight;
+  mmio_queue_t<mmio_req_addr_t> aw;
+  mmio_queue_t<mmio_req_addr_t> aw_inflight;
+  mmio_queue_t<mmio_req_data_t> w;
+  // Responses by id, as ids may answer out of order
+  std::vector<mmio_beat_queue_t> r;
+  std::vector<size_t> b;
+
   std::vector<char> dummy_data;
 };
 
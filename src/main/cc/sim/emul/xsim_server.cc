@@ -0,0 +1,70 @@
+// See LICENSE for license details.
+
+#include "simif_mock.h"
+#include "xsim_shm.h"
+#include <cassert>
+
+// Stand-in for the XSIM testbench on the shared-memory transport.
+// It serves the mock register model to a driver built with
+// -DSIMULATION_XSIM -DXSIM_SHM, so the transport itself can be exercised
+// and timed without Vivado. Takes the +mock-* options and:
+//   +xsim-shm=<file>  file shared with the driver (default /tmp/xsim_shm)
+class xsim_server_t: public simif_mock_t
+{
+public:
+  xsim_server_t(int argc, char** argv) {
+    init_model(argc, argv);
+  }
+
+  int serve(xsim_shm_t* shm) {
+    xsim_msg_t reqs[XSIM_RING_SIZE];
+    xsim_msg_t resps[XSIM_RING_SIZE];
+    while (true) {
+      shm->req.wait([shm] { return !shm->req.empty(); });
+      size_t n = shm->req.pop(reqs, XSIM_RING_SIZE);
+      size_t m = 0;
+      for (size_t i = 0 ; i < n ; i++) {
+        xsim_msg_t& msg = reqs[i];
+        switch (msg.cmd) {
+          case XSIM_READ:
+            msg.data = read(msg.addr >> 2);
+            resps[m++] = msg;
+            break;
+          case XSIM_WRITE:
+            write(msg.addr >> 2, msg.data);
+            break;
+          case XSIM_PULL:
+            msg.data = pull(msg.addr, shm->dma, msg.size) != (ssize_t)msg.size;
+            resps[m++] = msg;
+            break;
+          case XSIM_PUSH:
+            msg.data = push(msg.addr, shm->dma, msg.size) != (ssize_t)msg.size;
+            resps[m++] = msg;
+            break;
+          case XSIM_EXIT:
+            return 0;
+          default:
+            fprintf(stderr, "unknown xsim command %u\n", msg.cmd);
+            return 1;
+        }
+      }
+      // The driver drains responses as it goes, so this only waits on it
+      for (size_t i = 0 ; i < m ; ) {
+        i += shm->resp.push(resps + i, m - i);
+        if (i < m) shm->resp.wait([shm] { return !shm->resp.full(); });
+      }
+    }
+  }
+};
+
+int main(int argc, char** argv) {
+  const char* path = "/tmp/xsim_shm";
+  for (int i = 1 ; i < argc ; i++) {
+    std::string arg(argv[i]);
+    if (arg.find("+xsim-shm=") == 0) path = argv[i] + 10;
+  }
+  xsim_server_t server(argc, argv);
+  xsim_shm_t* shm = xsim_shm_map(path, false);
+  assert(shm);
+  return server.serve(shm);
+}
@@ -1,6 +1,7 @@
 // See LICENSE for license details.
 
 #include "address_map.h"
+#include <stdexcept>
 
 AddressMap::AddressMap(
     unsigned int r_register_count,
@@ -12,9 +13,31 @@ AddressMap::AddressMap(
 
   for (size_t i = 0; i < r_register_count; i++) {
     r_registers.insert(std::make_pair(r_register_names[i], r_register_addrs[i]));
+    r_index.insert(std::make_pair(r_register_names[i], r_names.size()));
+    r_names.push_back(r_register_names[i]);
+    r_addrs.push_back(r_register_addrs[i]);
   }
 
   for (size_t i = 0; i < w_register_count; i++) {
     w_registers.insert(std::make_pair(w_register_names[i], w_register_addrs[i]));
+    w_index.insert(std::make_pair(w_register_names[i], w_names.size()));
+    w_names.push_back(w_register_names[i]);
+    w_addrs.push_back(w_register_addrs[i]);
   }
 }
+
+r_register_t AddressMap::r_handle(const std::string& name) const {
+  auto it = r_index.find(name);
+  if (it == r_index.end()) {
+    throw std::runtime_error("No readable register: " + name);
+  }
+  return r_register(it->second);
+}
+
+w_register_t AddressMap::w_handle(const std::string& name) const {
+  auto it = w_index.find(name);
+  if (it == w_index.end()) {
+    throw std::runtime_error("No writable register: " + name);
+  }
+  return w_register(it->second);
+}
@@ -4,6 +4,23 @@
 #define __ADDRESS_MAP_H
 
 #include <map>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+// A register resolved once by name: its index among the map's registers
+// of that direction, and its address. Readable and writable registers
+// are told apart by type.
+struct r_register_t {
+  size_t index;
+  uint32_t addr;
+};
+
+struct w_register_t {
+  size_t index;
+  uint32_t addr;
+};
+
 // Maps midas compiler emited arrays to a more useful object, that can be
 // used to read and write to a local set of registers by their names
 //
@@ -19,13 +36,35 @@ public:
     const unsigned int* write_register_addrs,
     const char* const* write_register_names);
 
+  // Resolve a register by name, throwing std::runtime_error if the
+  // widget has none such
+  r_register_t r_handle(const std::string& name) const;
+  w_register_t w_handle(const std::string& name) const;
+
   // Look up register address based on name
-  uint32_t r_addr(std::string name) { return r_registers[name]; };
-  uint32_t w_addr(std::string name) { return w_registers[name]; };
+  uint32_t r_addr(const std::string& name) const { return r_handle(name).addr; };
+  uint32_t w_addr(const std::string& name) const { return w_handle(name).addr; };
+
+  // Registers in the order emitted, indexed by handle
+  size_t r_count() const { return r_addrs.size(); }
+  size_t w_count() const { return w_addrs.size(); }
+  const std::string& r_name(size_t index) const { return r_names[index]; }
+  const std::string& w_name(size_t index) const { return w_names[index]; }
+  r_register_t r_register(size_t index) const { return { index, r_addrs[index] }; }
+  w_register_t w_register(size_t index) const { return { index, w_addrs[index] }; }
 
   // Register name -> register addresses
   std::map<std::string, uint32_t> r_registers;
   std::map<std::string, uint32_t> w_registers;
+
+private:
+  std::vector<std::string> r_names;
+  std::vector<uint32_t> r_addrs;
+  std::vector<std::string> w_names;
+  std::vector<uint32_t> w_addrs;
+  // Name -> index
+  std::map<std::string, size_t> r_index;
+  std::map<std::string, size_t> w_index;
 };
 
 #endif // __ADDRESS_MAP_H
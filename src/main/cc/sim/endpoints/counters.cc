@@ -19,12 +19,14 @@ counters_t::counters_t(simif_t* s):
 
 counters_t::~counters_t()
 {
+  MMIO_PROFILE_PHASE(MMIO_PHASE_COUNTERS);
   dump();
   power_file.close();
   if (toggle_file.is_open()) toggle_file.close();
 }
 
 void counters_t::init(int argc, char** argv) {
+  MMIO_PROFILE_PHASE(MMIO_PHASE_COUNTERS);
   std::vector<std::string> args(argv + 1, argv + argc);
   std::string model_file = "model.csv";
   sample_file = "samples.csv";
@@ -52,22 +54,26 @@ void counters_t::init(int argc, char** argv) {
 }
 
 void counters_t::tick() {
-  if (read(COUNTER_BAUD))
+  MMIO_PROFILE_PHASE(MMIO_PHASE_COUNTERS);
+  if (status(TOGGLECOUNTERWIDGET_PENDING_BIT))
     compute_power(true, baudrate);
 }
 
 void counters_t::cache(size_t idx) {
-  write(COUNTER_READ, true);
+  data_t cur[NUM_TOGGLE_COUNTERS];
+  queue_write(COUNTER_READ, true);
   for (size_t i = 0 ; i < NUM_TOGGLE_COUNTERS ; i++) {
-    sample_cache[i] = read(TOGGLE_COUNTERS[i]);
+    queue_read(TOGGLE_COUNTERS[i], cur + i);
   }
+  flush();
+  std::copy(cur, cur + NUM_TOGGLE_COUNTERS, sample_cache.begin());
   has_cache = true;
   sample_idx = idx;
 }
 
 void counters_t::sample(size_t window) {
   if (has_cache) {
-    write(COUNTER_READ, true);
+    queue_write(COUNTER_READ, true);
     compute_power(false, window);
   }
   has_cache = false;
@@ -173,10 +179,16 @@ void counters_t::compute_power(bool baud, size_t window) {
     p.push_back(intercepts[k]);
   }
 
+  data_t counts[NUM_TOGGLE_COUNTERS];
+  for (size_t i = 0 ; i < NUM_TOGGLE_COUNTERS ; i++) {
+    queue_read(TOGGLE_COUNTERS[i], counts + i);
+  }
+  flush();
+
   uint32_t toggles[NUM_TOGGLE_COUNTERS];
   double toggle_rates[NUM_TOGGLE_COUNTERS];
   for (size_t i = 0 ; i < NUM_TOGGLE_COUNTERS ; i++) {
-    uint32_t cur  = read(TOGGLE_COUNTERS[i]);
+    uint32_t cur  = counts[i];
     uint32_t prev = baud ? baud_cache[i] : sample_cache[i];
     uint32_t toggle_count = cur - prev;
     toggles[i] = cur - prev;
@@ -15,6 +15,11 @@ public:
   virtual bool done() = 0;
 
 protected:
+  // Tests a bit of the status word read at the end of the last host iteration
+  inline bool status(size_t bit) {
+    return (sim->get_status() >> bit) & 0x1;
+  }
+
   inline void write(size_t addr, data_t data) {
     sim->write(addr, data);
   }
@@ -23,6 +28,18 @@ protected:
     return sim->read(addr);
   }
 
+  inline void queue_write(size_t addr, data_t data) {
+    sim->queue_write(addr, data);
+  }
+
+  inline void queue_read(size_t addr, data_t* data) {
+    sim->queue_read(addr, data);
+  }
+
+  inline void flush() {
+    sim->flush();
+  }
+
   inline ssize_t pull(size_t addr, char *data, size_t size) {
     return sim->pull(addr, data, size);
   }
@@ -31,6 +48,30 @@ protected:
     return sim->push(addr, data, size);
   }
 
+  inline bool has_dma() {
+    return sim->has_dma();
+  }
+
+  inline int pull_async(size_t addr, char *data, size_t size) {
+    return sim->pull_async(addr, data, size);
+  }
+
+  inline int push_async(size_t addr, char *data, size_t size) {
+    return sim->push_async(addr, data, size);
+  }
+
+  inline ssize_t dma_wait(int tag) {
+    return sim->dma_wait(tag);
+  }
+
+  inline char* dma_alloc(size_t size) {
+    return sim->dma_alloc(size);
+  }
+
+  inline void dma_free(char* data, size_t size) {
+    sim->dma_free(data, size);
+  }
+
 private:
   simif_t *sim;
 };
@@ -3,20 +3,110 @@
 #include <iostream>
 #include <algorithm>
 #include <exception>
+#include <sstream>
 #include <stdio.h>
 
 #include "fpga_memory_model.h"
 
+// Counters behind the derived rates
+static const char* const rate_counters[] = {
+  "LLC_READS", "LLC_WRITES", "MISSES",
+  "SAME_ROW_READS", "SAME_ROW_WRITES", "DIFF_ROW_READS", "DIFF_ROW_WRITES"
+};
+#define NUM_RATE_COUNTERS (sizeof(rate_counters) / sizeof(rate_counters[0]))
+
+// Finds the rate counters among names, returning false if any is missing
+static bool find_rate_counters(const std::vector<std::string>& names, size_t* idx) {
+  bool found = true;
+  for (size_t i = 0 ; i < NUM_RATE_COUNTERS ; i++) {
+    idx[i] = std::find(names.begin(), names.end(), rate_counters[i]) - names.begin();
+    found &= idx[i] < names.size();
+  }
+  return found;
+}
+
+// Accesses per cycle, miss rate and row-hit rate from counter deltas
+static void rates(const size_t* idx, const uint64_t* deltas, uint64_t cycles, double* r) {
+  auto d = [&](size_t i) { return (double)deltas[idx[i]]; };
+  const double accesses = d(0) + d(1);
+  const double same = d(3) + d(4), rows = same + d(5) + d(6);
+  r[0] = cycles ? accesses / cycles : 0.0;
+  r[1] = accesses ? d(2) / accesses : 0.0;
+  r[2] = rows ? same / rows : 0.0;
+}
+
 FpgaMemoryModel::FpgaMemoryModel(
     simif_t* sim, AddressMap addr_map)
-  : FpgaModel(sim, addr_map) {
+  : FpgaModel(sim, addr_map), profile_prefix("memmodel-profile"),
+    profile_file(NULL), last_profile(0), sweep_warmup(0), sweep_interval(1000000),
+    sweep_next(0), sweep_start(0) {
+  const std::string low = "_LOW", high = "_HIGH";
+  for (size_t i = 0 ; i < addr_map.r_count() ; i++) {
+    const std::string& name = addr_map.r_name(i);
+    const size_t n = name.size();
+    counter_t c = { name, addr_map.r_register(i), addr_map.r_register(i), false };
+    if (n > low.size() && !name.compare(n - low.size(), low.size(), low)) {
+      const std::string base = name.substr(0, n - low.size());
+      if (addr_map.r_registers.count(base + high)) {
+        c.name = base;
+        c.high = addr_map.r_handle(base + high);
+        c.wide = true;
+      }
+    } else if (n > high.size() && !name.compare(n - high.size(), high.size(), high) &&
+               addr_map.r_registers.count(name.substr(0, n - high.size()) + low)) {
+      continue;
+    }
+    counters.push_back(c);
+  }
+  values.resize(counters.size());
+  record.resize(counters.size() + 1);
+}
+
+FpgaMemoryModel::~FpgaMemoryModel() {
+  if (profile_file) fclose(profile_file);
+}
+
+// Samples every register in one batch; the target is stopped between
+// steps, so the halves of a counter agree
+void FpgaMemoryModel::sample_counters() {
+  const std::vector<data_t>& regs = snapshot_all();
+  for (size_t i = 0 ; i < counters.size() ; i++) {
+    const counter_t& c = counters[i];
+    values[i] = c.wide ?
+      ((uint64_t)regs[c.high.index] << 32) | regs[c.low.index] : regs[c.low.index];
+  }
 }
 
 void FpgaMemoryModel::profile() {
+  MMIO_PROFILE_PHASE(MMIO_PHASE_FPGA_MODEL);
+  if (!profile_file) {
+    if (profile_prefix.empty()) return;
+    profile_file = fopen((profile_prefix + ".bin").c_str(), "wb");
+    if (!profile_file) {
+      fprintf(stderr, "Cannot open %s.bin\n", profile_prefix.c_str());
+      profile_prefix.clear();
+      return;
+    }
+    const uint32_t n = counters.size();
+    fwrite(&n, sizeof(n), 1, profile_file);
+    for (auto &c: counters) {
+      fwrite(c.name.c_str(), 1, c.name.size() + 1, profile_file);
+    }
+  }
+
+  sample_counters();
+  record[0] = last_profile = cycles();
+  std::copy(values.begin(), values.end(), record.begin() + 1);
+  if (fwrite(&record[0], sizeof(uint64_t), record.size(), profile_file) != record.size()) {
+    perror((profile_prefix + ".bin").c_str());
+  }
 }
 
 void FpgaMemoryModel::init(int argc, char** argv) {
+  MMIO_PROFILE_PHASE(MMIO_PHASE_FPGA_MODEL);
   std::vector<std::string> args(argv + 1, argv + argc);
+  std::vector<std::pair<std::string, std::vector<data_t> > > sweep_lists;
+  std::vector<w_register_t> sweep_regs;
   for (auto &arg: args) {
     if(arg.find("+mm_") == 0) {
       auto sub_arg = std::string(arg.c_str() + 4);
@@ -25,21 +115,99 @@ void FpgaMemoryModel::init(int argc, char** argv) {
       int value = std::stoi(sub_arg.substr(delimit_idx+1).c_str());
       model_configuration[key] = value;
     }
+    if (arg.find("+memmodel-profile=") == 0) {
+      profile_prefix = arg.substr(18);
+    }
+    if (arg.find("+mm-sweep=") == 0) {
+      const std::string sweep_arg = arg.substr(10);
+      const size_t delimit_idx = sweep_arg.find_first_of("=");
+      const std::string key = sweep_arg.substr(0, delimit_idx);
+      const w_register_t reg = addr_map.w_handle(key);
+      std::vector<data_t> list;
+      std::stringstream ss(sweep_arg.substr(delimit_idx + 1));
+      std::string value;
+      while (std::getline(ss, value, ',')) {
+        list.push_back(std::stoul(value));
+      }
+      sweep_lists.push_back(std::make_pair(key, list));
+      sweep_regs.push_back(reg);
+    }
+    if (arg.find("+mm-sweep-interval=") == 0) {
+      sweep_interval = std::max(1ULL, strtoull(arg.c_str() + 19, NULL, 10));
+    }
+    if (arg.find("+mm-sweep-warmup=") == 0) {
+      sweep_warmup = strtoull(arg.c_str() + 17, NULL, 10);
+    }
   }
 
   for (auto &pair: addr_map.w_registers) {
     auto value_it = model_configuration.find(pair.first);
     if (value_it != model_configuration.end()) {
-      write(pair.second, value_it->second);
+      queue_write(pair.second, value_it->second);
     } else {
       char buf[100];
       sprintf(buf, "No value provided for configuration register: %s", pair.first.c_str());
       throw std::runtime_error(buf);
     }
   }
+  flush();
+
+  size_t points = 0;
+  for (auto &list: sweep_lists) points = std::max(points, list.second.size());
+  sweep.resize(points);
+  for (size_t i = 0 ; i < sweep_lists.size() ; i++) {
+    const std::vector<data_t>& list = sweep_lists[i].second;
+    if (list.size() != 1 && list.size() != points) {
+      throw std::runtime_error("+mm-sweep of " + sweep_lists[i].first + " has " +
+        std::to_string(list.size()) + " values instead of 1 or " + std::to_string(points));
+    }
+    for (size_t j = 0 ; j < points ; j++) {
+      sweep_setting_t setting = { sweep_lists[i].first, sweep_regs[i], list[list.size() == 1 ? 0 : j] };
+      sweep[j].settings.push_back(setting);
+    }
+  }
+  sweep_values.resize(counters.size());
+}
+
+uint64_t FpgaMemoryModel::next_event() {
+  if (sweep_next > sweep.size() || sweep.empty()) return UINT64_MAX;
+  return sweep_warmup + sweep_next * sweep_interval;
+}
+
+// Closes the point being measured, applies the next one, and puts the
+// +mm_ settings back after the last
+void FpgaMemoryModel::handle_event() {
+  MMIO_PROFILE_PHASE(MMIO_PHASE_FPGA_MODEL);
+  if (sweep_next > 0) end_sweep_point();
+  if (sweep_next < sweep.size()) {
+    for (auto &setting: sweep[sweep_next].settings) {
+      queue_write(setting.reg, setting.value);
+    }
+    flush();
+    sample_counters();
+    sweep_values = values;
+    sweep_start = cycles();
+  } else {
+    for (auto &setting: sweep.back().settings) {
+      queue_write(setting.reg, model_configuration[setting.name]);
+    }
+    flush();
+  }
+  sweep_next++;
+}
+
+void FpgaMemoryModel::end_sweep_point() {
+  sweep_point_t& point = sweep[sweep_next - 1];
+  sample_counters();
+  point.cycles = cycles() - sweep_start;
+  point.counts.resize(counters.size());
+  for (size_t i = 0 ; i < counters.size() ; i++) {
+    point.counts[i] = values[i] - sweep_values[i];
+  }
 }
 
 void FpgaMemoryModel::finish() {
+  MMIO_PROFILE_PHASE(MMIO_PHASE_FPGA_MODEL);
 #ifdef MEMMODEL_0
 #define readw(x) \
   ((size_t)read(MEMMODEL_0_ ## x ## _HIGH) << 32) | \
@@ -64,4 +232,93 @@ void FpgaMemoryModel::finish() {
                   diff_row_reads + diff_row_writes);
 #undef readw
 #endif
+
+  if (!sweep.empty()) {
+    // A point cut short by the end of the run is reported as far as it got
+    if (sweep_next > 0 && sweep_next <= sweep.size() && cycles() > sweep_start) {
+      end_sweep_point();
+      sweep_next = sweep.size() + 1;
+    }
+    std::vector<std::string> names;
+    for (auto &c: counters) names.push_back(c.name);
+    size_t idx[NUM_RATE_COUNTERS];
+    const bool has_rates = find_rate_counters(names, idx);
+    fprintf(stderr, "Memory Model Sweep\n");
+    for (auto &point: sweep) {
+      if (point.counts.empty()) continue;
+      fprintf(stderr, " -");
+      for (auto &setting: point.settings) {
+        fprintf(stderr, " %s=%u", setting.name.c_str(), setting.value);
+      }
+      fprintf(stderr, " (%llu cycles):", (unsigned long long)point.cycles);
+      for (size_t i = 0 ; i < counters.size() ; i++) {
+        fprintf(stderr, "%s %s %llu", i ? "," : "", counters[i].name.c_str(),
+                (unsigned long long)point.counts[i]);
+      }
+      if (has_rates) {
+        double r[3];
+        rates(idx, &point.counts[0], point.cycles, r);
+        fprintf(stderr, ", %.6f accesses/cycle, miss rate %.6f, row-hit rate %.6f",
+                r[0], r[1], r[2]);
+      }
+      fprintf(stderr, "\n");
+    }
+  }
+
+  if (profile_file) {
+    if (cycles() != last_profile) profile();
+    fclose(profile_file);
+    profile_file = NULL;
+    if (export_csv(profile_prefix + ".bin", profile_prefix + ".csv")) {
+      fprintf(stderr, "Memory model profile: %s.csv\n", profile_prefix.c_str());
+    }
+  }
+}
+
+bool FpgaMemoryModel::export_csv(const std::string& bin, const std::string& csv) {
+  FILE* in = fopen(bin.c_str(), "rb");
+  if (!in) {
+    fprintf(stderr, "Cannot open %s\n", bin.c_str());
+    return false;
+  }
+  uint32_t n = 0;
+  std::vector<std::string> names;
+  if (fread(&n, sizeof(n), 1, in) == 1) {
+    names.resize(n);
+    for (auto &name: names) {
+      int c;
+      while ((c = fgetc(in)) > 0) name.push_back(c);
+    }
+  }
+  FILE* out = fopen(csv.c_str(), "w");
+  if (!out) {
+    fprintf(stderr, "Cannot open %s\n", csv.c_str());
+    fclose(in);
+    return false;
+  }
+
+  size_t idx[NUM_RATE_COUNTERS];
+  const bool has_rates = find_rate_counters(names, idx);
+
+  fprintf(out, "cycle");
+  for (auto &name: names) fprintf(out, ",%s", name.c_str());
+  if (has_rates) fprintf(out, ",accesses_per_cycle,miss_rate,row_hit_rate");
+  fprintf(out, "\n");
+
+  std::vector<uint64_t> prev(n + 1, 0), cur(n + 1), delta(n + 1);
+  while (fread(&cur[0], sizeof(uint64_t), n + 1, in) == n + 1) {
+    for (size_t i = 0 ; i <= n ; i++) delta[i] = cur[i] - prev[i];
+    fprintf(out, "%llu", (unsigned long long)cur[0]);
+    for (size_t i = 1 ; i <= n ; i++) fprintf(out, ",%llu", (unsigned long long)delta[i]);
+    if (has_rates) {
+      double r[3];
+      rates(idx, &delta[1], delta[0], r);
+      fprintf(out, ",%.6f,%.6f,%.6f", r[0], r[1], r[2]);
+    }
+    fprintf(out, "\n");
+    prev = cur;
+  }
+  fclose(out);
+  fclose(in);
+  return true;
 }
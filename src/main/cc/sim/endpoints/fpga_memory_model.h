@@ -5,23 +5,82 @@
 
 #include <unordered_map>
 #include <fstream>
+#include <vector>
 
 #include "fpga_model.h"
 
 // Driver for the midas memory model
+//
+// With +profile-interval=<cycles>, profile() appends the readable
+// registers to <prefix>.bin every interval, with the prefix from
+// +memmodel-profile=<prefix> (memmodel-profile by default). The file
+// starts with the number of counters (uint32_t) and their NUL-terminated
+// names, followed by one record per interval: the cycle and the running
+// value of each counter, all uint64_t in host byte order. finish() adds
+// a last record and exports the series to <prefix>.csv.
+//
+// +mm-sweep=<register>=<value>,<value>,... sweeps the configuration in
+// one run: after +mm-sweep-warmup=<cycles> on the +mm_ settings, the
+// values are applied in turn, each for +mm-sweep-interval=<cycles>,
+// and finish() reports the counters of every point. Registers swept
+// together take their values by position, a single value holding for
+// all points. LLC geometry changes keep the lines already cached.
 
 class FpgaMemoryModel: public FpgaModel
 {
 public:
   FpgaMemoryModel(simif_t* s, AddressMap addr_map);
-  virtual ~FpgaMemoryModel() { }
+  virtual ~FpgaMemoryModel();
   void init(int argc, char** argv);
   void profile();
   void finish();
+  virtual uint64_t next_event();
+  virtual void handle_event();
+
+  // Writes the per-interval deltas of a profile as CSV, along with the
+  // bandwidth (accesses per cycle), miss rate and row-hit rate
+  static bool export_csv(const std::string& bin, const std::string& csv);
 
 private:
   // Saves a map of register names to settings
   std::unordered_map<std::string, uint32_t> model_configuration;
+
+  // Readable registers, with _LOW/_HIGH pairs as one 64-bit counter
+  struct counter_t {
+    std::string name;
+    r_register_t low;
+    r_register_t high;
+    bool wide;
+  };
+  std::vector<counter_t> counters;
+  // Counter values as of the last sample_counters()
+  std::vector<uint64_t> values;
+  std::vector<uint64_t> record;
+  std::string profile_prefix;
+  FILE* profile_file;
+  uint64_t last_profile;
+
+  struct sweep_setting_t {
+    std::string name;
+    w_register_t reg;
+    data_t value;
+  };
+  struct sweep_point_t {
+    std::vector<sweep_setting_t> settings;
+    uint64_t cycles;
+    std::vector<uint64_t> counts;
+  };
+  std::vector<sweep_point_t> sweep;
+  uint64_t sweep_warmup;
+  uint64_t sweep_interval;
+  // The next event starts point sweep_next, or restores the +mm_
+  // settings after the last
+  size_t sweep_next;
+  uint64_t sweep_start;
+  std::vector<uint64_t> sweep_values;
+
+  void sample_counters();
+  void end_sweep_point();
 };
 
 #endif // __FPGA_MEMORY_MODEL_H
@@ -17,6 +17,9 @@
  * 2) profile: Which gives a default means to read all readable registers in
  * the model, including programmable registers and instrumentation.
  *
+ * Registers are best resolved to handles once, with addr_map.r_handle() and
+ * w_handle(); snapshot_all() then samples every readable register in one
+ * batch, by handle.
  */
 
 class FpgaModel
@@ -25,14 +28,22 @@ private:
   simif_t *sim;
 
 public:
-  FpgaModel(simif_t* s, AddressMap addr_map): sim(s), addr_map(addr_map) {};
+  FpgaModel(simif_t* s, AddressMap addr_map):
+    sim(s), addr_map(addr_map), snapshot(addr_map.r_count()) {};
   virtual ~FpgaModel() { }
   virtual void init(int argc, char** argv) = 0;
   virtual void profile() = 0;
   virtual void finish() = 0;
 
+  // Target cycle the model next has to act at, which blocking steps stop
+  // at to call handle_event(); handle_event() moves it on
+  virtual uint64_t next_event() { return UINT64_MAX; }
+  virtual void handle_event() { }
+
 protected:
   AddressMap addr_map;
+  // Readable registers as of the last snapshot_all(), indexed by handle
+  std::vector<data_t> snapshot;
 
   void write(size_t addr, data_t data) {
     sim->write(addr, data);
@@ -42,6 +53,18 @@ protected:
     return sim->read(addr);
   }
 
+  void queue_write(size_t addr, data_t data) {
+    sim->queue_write(addr, data);
+  }
+
+  void queue_read(size_t addr, data_t* data) {
+    sim->queue_read(addr, data);
+  }
+
+  void flush() {
+    sim->flush();
+  }
+
   void write(std::string reg, data_t data){
     sim->write(addr_map.w_addr(reg), data);
   }
@@ -50,6 +73,34 @@ protected:
     return sim->read(addr_map.r_addr(reg));
   }
 
+  data_t read(r_register_t reg) {
+    return sim->read(reg.addr);
+  }
+
+  void write(w_register_t reg, data_t data) {
+    sim->write(reg.addr, data);
+  }
+
+  void queue_read(r_register_t reg, data_t* data) {
+    sim->queue_read(reg.addr, data);
+  }
+
+  void queue_write(w_register_t reg, data_t data) {
+    sim->queue_write(reg.addr, data);
+  }
+
+  const std::vector<data_t>& snapshot_all() {
+    for (size_t i = 0 ; i < snapshot.size() ; i++) {
+      sim->queue_read(addr_map.r_register(i).addr, &snapshot[i]);
+    }
+    sim->flush();
+    return snapshot;
+  }
+
+  uint64_t cycles() {
+    return sim->cycles();
+  }
+
 };
 
 #endif // __FPGA_MODEL_H
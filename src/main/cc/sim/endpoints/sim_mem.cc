@@ -2,58 +2,97 @@
 
 #include <algorithm>
 #include <stdio.h>
+#include <cassert>
+#include <pthread.h>
 
 #include "sim_mem.h"
-// TODO: support multi channels
+#include "spsc_ring.h"
+#include "mm_profile.h"
 
-sim_mem_t::sim_mem_t(simif_t* sim, int argc, char** argv): endpoint_t(sim) {
-#ifdef NASTIWIDGET_0
+sim_mem_t::sim_mem_t(simif_t* sim, AddressMap addr_map, size_t done_bit, size_t pending_bit,
+                     size_t channel, size_t nchannels, size_t dma_addr):
+    endpoint_t(sim), mem(NULL), done_bit(done_bit), pending_bit(pending_bit),
+    channel(channel), nchannels(nchannels), dma_addr(dma_addr), dma_req(NULL), dma_resp(NULL),
+    _stall(false), max_run_ahead(UINT64_MAX), granted(0), num_reads(0), num_writes(0) {
+  memset(&data, 0, sizeof(data));
+  // Narrow address buses pack the address and the metadata in one register
+  regs.ar_packed = addr_map.r_registers.count("ar_bits");
+  regs.aw_packed = addr_map.r_registers.count("aw_bits");
+  if (regs.ar_packed) {
+    regs.ar_bits = addr_map.r_addr("ar_bits");
+  } else {
+    regs.ar_addr = addr_map.r_addr("ar_addr");
+    regs.ar_meta = addr_map.r_addr("ar_meta");
+  }
+  if (regs.aw_packed) {
+    regs.aw_bits = addr_map.r_addr("aw_bits");
+  } else {
+    regs.aw_addr = addr_map.r_addr("aw_addr");
+    regs.aw_meta = addr_map.r_addr("aw_meta");
+  }
+  regs.w_meta = addr_map.r_addr("w_meta");
+  regs.r_meta = addr_map.w_addr("r_meta");
+  for (size_t i = 0 ; i < MEM_CHUNKS ; i++) {
+    regs.w_data[i] = addr_map.r_addr("w_data_" + std::to_string(i));
+    regs.r_data[i] = addr_map.w_addr("r_data_" + std::to_string(i));
+  }
+  regs.b_meta = addr_map.w_addr("b_meta");
+  regs.valid = addr_map.r_addr("valid");
+  regs.ready = addr_map.w_addr("ready");
+  regs.delta = addr_map.w_addr("delta");
+  regs.delta_left = addr_map.r_addr("delta_left");
+}
+
+sim_mem_t::~sim_mem_t() {
+  if (dma_req) dma_free(dma_req, SIM_MEM_DMA_RECORDS * DMA_WIDTH);
+  if (dma_resp) dma_free(dma_resp, DMA_WIDTH);
+  delete mem;
+}
+
+void sim_mem_t::init(int argc, char** argv) {
   std::vector<std::string> args(argv + 1, argv + argc);
-  bool dramsim = false;
-  uint64_t memsize = 1L << 26; // 64 KB
-  const char* loadmem = NULL;
+  mm_model_t model = MM_MODEL_MAGIC;
+  uint64_t memsize = 1L << 26; // 64 MB across the channels
+  mm_pages_t pages = MM_PAGES_DEFAULT;
+  std::string image, save_image;
   for (auto &arg: args) {
-    if (arg.find("+dramsim") == 0) {
-      dramsim = true;
-    }
-    else if (arg.find("+memsize=") == 0) {
+    mm_parse_pages(arg, &pages);
+    mm_parse_model(arg, &model);
+    mm_parse_image(arg, &image, &save_image);
+    if (arg.find("+memsize=") == 0) {
       memsize = strtoll(arg.c_str() + 9, NULL, 10);
     }
-    else if (arg.find("+loadmem=") == 0) {
-      loadmem = arg.c_str() + 9;
+    if (arg.find("+mm-run-ahead=") == 0) {
+      max_run_ahead = std::max(1ULL, strtoull(arg.c_str() + 14, NULL, 10));
     }
   }
-  mem = dramsim ? (mm_t*) new mm_dramsim2_t : (mm_t*) new mm_magic_t;
-  mem->init(memsize, MEM_DATA_BITS / 8, 64);
-  if (loadmem) {
-    fprintf(stderr, "[sw loadmem] %s\n", loadmem);
-    void* mems[1];
-    mems[0] = mem->get_data();
-    ::load_mem(mems, loadmem, MEM_DATA_BITS / 8, 1);
+  mem = mm_new(model);
+  mem->parse_args(args);
+  mem->set_pages(pages);
+  // Channel stores follow each other in one image
+  if (!image.empty()) mem->set_image(image, channel * (memsize / nchannels));
+  mem->init(memsize / nchannels, MEM_DATA_BITS / 8, SIM_MEM_LINE_SIZE);
+  mm_profile_init(mem, args, nchannels > 1 ? "." + std::to_string(channel) : "");
+  if (dma_addr != SIM_MEM_NO_DMA && has_dma()) {
+    if (SIM_MEM_REQ_WORDS * sizeof(uint64_t) > DMA_WIDTH) {
+      fprintf(stderr, "Memory channel %zu: request records don't fit DMA beats\n", channel);
+      abort();
+    }
+    dma_req = dma_alloc(SIM_MEM_DMA_RECORDS * DMA_WIDTH);
+    dma_resp = dma_alloc(DMA_WIDTH);
   }
-#endif
 }
 
 void sim_mem_t::delta(size_t t) {
-#ifdef NASTIWIDGET_0
-  write(NASTIWIDGET_0(delta), t);
-#endif
+  write(regs.delta, t);
 }
 
 bool sim_mem_t::stall() {
-#ifdef NASTIWIDGET_0
-  return read(NASTIWIDGET_0(stall));
-#else
-  return false;
-#endif
+  return status(pending_bit);
 }
 
 bool sim_mem_t::done() {
-#ifdef NASTIWIDGET_0
-  return read(NASTIWIDGET_0(done));
-#else
-  return true;
-#endif
+  return status(done_bit);
 }
 
 const uint64_t addr_mask = (1ULL << MEM_ADDR_BITS) - 1;
@@ -63,67 +102,165 @@ const data_t len_mask = (1 << MEM_LEN_BITS) - 1;
 const data_t strb_mask = (1 << MEM_STRB_BITS) - 1;
 
 void sim_mem_t::recv(sim_mem_data_t& data) {
-#ifdef NASTIWIDGET_0
-  data_t valid = read(NASTIWIDGET_0(valid));
+  data_t valid = read(regs.valid);
   data.ar.valid = (valid >> 4) & 0x1;
   data.aw.valid = (valid >> 3) & 0x1;
   data.w.valid = (valid >> 2) & 0x1;
   data.r.ready = (valid >> 1) & 0x1;
   data.b.ready = valid & 0x1;
 
+  // Fetch every firing channel in a single batch
+  data_t ar_bits, ar_addr, aw_bits, aw_addr, w_meta;
   if (data.ar.fire()) {
-#ifdef NASTIWIDGET_0_ar_bits
-    data_t bits = read(NASTIWIDGET_0(ar_bits));
-    data.ar.addr = (bits >> (MEM_ID_BITS + MEM_SIZE_BITS + MEM_LEN_BITS)) & addr_mask;
-#else
-    data_t bits = read(NASTIWIDGET_0(ar_meta));
-    data.ar.addr = read(NASTIWIDGET_0(ar_addr));
-#endif
-    data.ar.id = (bits >> (MEM_SIZE_BITS + MEM_LEN_BITS)) & id_mask;
-    data.ar.size = (bits >> MEM_LEN_BITS) & size_mask;
-    data.ar.len = bits & len_mask;
+    if (regs.ar_packed) {
+      queue_read(regs.ar_bits, &ar_bits);
+    } else {
+      queue_read(regs.ar_meta, &ar_bits);
+      queue_read(regs.ar_addr, &ar_addr);
+    }
   }
-
   if (data.aw.fire()) {
-#ifdef NASTIWIDGET_0_aw_bits
-    data_t bits = read(NASTIWIDGET_0(aw_bits));
-    data.aw.addr = (bits >> (MEM_ID_BITS + MEM_SIZE_BITS + MEM_LEN_BITS)) & addr_mask;
-#else
-    data_t bits = read(NASTIWIDGET_0(aw_meta));
-    data.aw.addr = read(NASTIWIDGET_0(aw_addr));
-#endif
-    data.aw.id = (bits >> (MEM_SIZE_BITS + MEM_LEN_BITS)) & id_mask;
-    data.aw.size = (bits >> MEM_LEN_BITS) & size_mask;
-    data.aw.len = bits & len_mask;
+    if (regs.aw_packed) {
+      queue_read(regs.aw_bits, &aw_bits);
+    } else {
+      queue_read(regs.aw_meta, &aw_bits);
+      queue_read(regs.aw_addr, &aw_addr);
+    }
   }
   if (data.w.fire()) {
-    data_t meta = read(NASTIWIDGET_0(w_meta));
-    data.w.strb = (meta >> 1) & strb_mask;
-    data.w.last = meta & 0x1;
+    queue_read(regs.w_meta, &w_meta);
     for (size_t i = 0; i < MEM_CHUNKS; i++) {
-      data.w.data[i] = read(NASTIWIDGET_0(w_data[i]));
+      queue_read(regs.w_data[i], &data.w.data[i]);
+    }
+  }
+  flush();
+
+  if (data.ar.fire()) {
+    data.ar.addr = regs.ar_packed ?
+      (ar_bits >> (MEM_ID_BITS + MEM_SIZE_BITS + MEM_LEN_BITS)) & addr_mask : ar_addr;
+    data.ar.id = (ar_bits >> (MEM_SIZE_BITS + MEM_LEN_BITS)) & id_mask;
+    data.ar.size = (ar_bits >> MEM_LEN_BITS) & size_mask;
+    data.ar.len = ar_bits & len_mask;
+  }
+  if (data.aw.fire()) {
+    data.aw.addr = regs.aw_packed ?
+      (aw_bits >> (MEM_ID_BITS + MEM_SIZE_BITS + MEM_LEN_BITS)) & addr_mask : aw_addr;
+    data.aw.id = (aw_bits >> (MEM_SIZE_BITS + MEM_LEN_BITS)) & id_mask;
+    data.aw.size = (aw_bits >> MEM_LEN_BITS) & size_mask;
+    data.aw.len = aw_bits & len_mask;
+  }
+  if (data.w.fire()) {
+    data.w.strb = (w_meta >> 1) & strb_mask;
+    data.w.last = w_meta & 0x1;
+  }
+}
+
+// One pull of the records of the beats the target has issued since the
+// last one, which returns the cycles left of the last delta
+size_t sim_mem_t::pull_requests(sim_mem_data_t& data) {
+  const ssize_t size = SIM_MEM_DMA_RECORDS * DMA_WIDTH;
+  if (pull(dma_addr, dma_req, size) != size) {
+    fprintf(stderr, "Memory channel %zu: pulling requests failed\n", channel);
+    abort();
+  }
+  for (size_t i = 0 ; i < SIM_MEM_DMA_RECORDS ; i++) {
+    const uint64_t* rec = (const uint64_t*)(dma_req + i * DMA_WIDTH);
+    if ((rec[0] >> 4) & 0x1) {
+      ar_beats.emplace_back();
+      ar_beats.back().addr = rec[1] & addr_mask;
+      ar_beats.back().id = (rec[2] >> (MEM_SIZE_BITS + MEM_LEN_BITS)) & id_mask;
+      ar_beats.back().size = (rec[2] >> MEM_LEN_BITS) & size_mask;
+      ar_beats.back().len = rec[2] & len_mask;
+    }
+    if ((rec[0] >> 3) & 0x1) {
+      aw_beats.emplace_back();
+      aw_beats.back().addr = rec[3] & addr_mask;
+      aw_beats.back().id = (rec[4] >> (MEM_SIZE_BITS + MEM_LEN_BITS)) & id_mask;
+      aw_beats.back().size = (rec[4] >> MEM_LEN_BITS) & size_mask;
+      aw_beats.back().len = rec[4] & len_mask;
+    }
+    if ((rec[0] >> 2) & 0x1) {
+      w_beats.emplace_back();
+      w_beats.back().strb = (rec[5] >> 1) & strb_mask;
+      w_beats.back().last = rec[5] & 0x1;
+      memcpy(w_beats.back().data, rec + 6, MEM_DATA_BITS / 8);
     }
   }
-#endif
+  // The last record has the latest room in the R and B buffers
+  const uint64_t last = *(const uint64_t*)(dma_req + (SIM_MEM_DMA_RECORDS - 1) * DMA_WIDTH);
+  data.r.ready = (last >> 1) & 0x1;
+  data.b.ready = last & 0x1;
+  return last >> 32;
+}
+
+// As recv(), from the beats pulled in place of the register reads
+void sim_mem_t::recv_dma(sim_mem_data_t& data) {
+  data.ar.valid = !ar_beats.empty();
+  if (data.ar.valid) {
+    data.ar.addr = ar_beats.front().addr;
+    data.ar.id = ar_beats.front().id;
+    data.ar.size = ar_beats.front().size;
+    data.ar.len = ar_beats.front().len;
+    if (data.ar.fire()) ar_beats.pop_front();
+  }
+  data.aw.valid = !aw_beats.empty();
+  if (data.aw.valid) {
+    data.aw.addr = aw_beats.front().addr;
+    data.aw.id = aw_beats.front().id;
+    data.aw.size = aw_beats.front().size;
+    data.aw.len = aw_beats.front().len;
+    if (data.aw.fire()) aw_beats.pop_front();
+  }
+  data.w.valid = !w_beats.empty();
+  if (data.w.valid) {
+    memcpy(data.w.data, w_beats.front().data, sizeof(data.w.data));
+    data.w.strb = w_beats.front().strb;
+    data.w.last = w_beats.front().last;
+    if (data.w.fire()) w_beats.pop_front();
+  }
+}
+
+// As send() and delta(), with one push of the response record. The ready
+// bits are those of the beats taken, which the widget then dequeues.
+void sim_mem_t::send_dma(sim_mem_data_t& data, size_t delta) {
+  uint64_t* rec = (uint64_t*)dma_resp;
+  rec[0] = ((uint64_t)delta << 32) |
+           ((uint64_t)data.ar.fire() << 4) |
+           ((uint64_t)data.aw.fire() << 3) |
+           ((uint64_t)data.w.fire() << 2) |
+           ((uint64_t)data.r.fire() << 1) |
+           ((uint64_t)data.b.fire());
+  if (!rec[0]) return;
+  if (data.r.fire()) {
+    rec[1] = ((uint64_t)data.r.id << (MEM_RESP_BITS + 1)) |
+             ((uint64_t)data.r.resp << 1) | data.r.last;
+    memcpy(rec + 3, data.r.data, MEM_DATA_BITS / 8);
+  }
+  if (data.b.fire()) {
+    rec[2] = ((uint64_t)data.b.id << MEM_RESP_BITS) | data.b.resp;
+  }
+  if (push(dma_addr, dma_resp, DMA_WIDTH) != (ssize_t)DMA_WIDTH) {
+    fprintf(stderr, "Memory channel %zu: pushing a response failed\n", channel);
+    abort();
+  }
 }
 
 void sim_mem_t::send(sim_mem_data_t& data) {
-#ifdef NASTIWIDGET_0
   if (data.r.fire()) {
     data_t meta = 0x0;
     meta |= ((data_t)data.r.id) << (MEM_RESP_BITS + 1);
     meta |= ((data_t)data.r.resp) << 1;
     meta |= ((data_t)data.r.last);
-    write(NASTIWIDGET_0(r_meta), meta);
+    queue_write(regs.r_meta, meta);
     for (size_t i = 0 ; i < MEM_CHUNKS ; i++) {
-      write(NASTIWIDGET_0(r_data[i]), data.r.data[i]);
+      queue_write(regs.r_data[i], data.r.data[i]);
     }
   }
   if (data.b.fire()) {
     data_t meta = 0x0;
     meta |= ((data_t)data.b.id) << MEM_RESP_BITS;
     meta |= ((data_t)data.b.resp);
-    write(NASTIWIDGET_0(b_meta), meta);
+    queue_write(regs.b_meta, meta);
   }
 
   data_t ready = 0x0;
@@ -132,75 +269,240 @@ void sim_mem_t::send(sim_mem_data_t& data) {
   ready |= ((data_t)data.w.ready) << 2;
   ready |= ((data_t)data.r.valid) << 1;
   ready |= ((data_t)data.b.valid);
-  write(NASTIWIDGET_0(ready), ready);
-#endif
+  queue_write(regs.ready, ready);
+  flush();
 }
 
-void sim_mem_t::tick() {
-#ifdef NASTIWIDGET_0
-  bool _stall = this->stall();
-  static size_t num_reads = 0;
-  static size_t num_writes = 0;
-  static sim_mem_data_t data;
-  if (_stall || num_reads || num_writes) {
-    data.ar.ready = mem->ar_ready();
-    data.aw.ready = mem->aw_ready();
-    data.w.ready = mem->w_ready();
+bool sim_mem_t::begin_tick() {
+  _stall = this->stall();
+  // The target is still running the delta granted last
+  if (granted > 1 && !_stall) return false;
+  if (!_stall && !num_reads && !num_writes) return false;
 
+  // The model catches up with the cycles the target ran of the last delta,
+  // all of them unless a request cut it short
+  const size_t left = use_dma() ? this->pull_requests(data) :
+                      granted > 1 ? read(regs.delta_left) : 0;
+  if (granted > 1) mem->idle(granted - 1 - left);
+  granted = 0;
+
+  data.ar.ready = mem->ar_ready();
+  data.aw.ready = mem->aw_ready();
+  data.w.ready = mem->w_ready();
+
+  if (use_dma()) {
+    this->recv_dma(data);
+  } else {
     this->recv(data);
+  }
+
+  if (data.ar.fire()) num_reads++;
+  if (data.aw.fire()) num_writes++;
+  return true;
+}
+
+void sim_mem_t::tick_model() {
+  mem->tick(
+    false,
+    data.ar.valid,
+    local_addr(data.ar.addr),
+    data.ar.id,
+    data.ar.size,
+    data.ar.len,
+
+    data.aw.valid,
+    local_addr(data.aw.addr),
+    data.aw.id,
+    data.aw.size,
+    data.aw.len,
+
+    data.w.valid,
+    data.w.strb,
+    data.w.data,
+    data.w.last,
 
-    if (data.ar.fire()) num_reads++;
-    if (data.aw.fire()) num_writes++;
-
-    mem->tick(
-      false,
-      data.ar.valid,
-      data.ar.addr,
-      data.ar.id,
-      data.ar.size,
-      data.ar.len,
-
-      data.aw.valid,
-      data.aw.addr,
-      data.aw.id,
-      data.aw.size,
-      data.aw.len,
-
-      data.w.valid,
-      data.w.strb,
-      data.w.data,
-      data.w.last,
-
-      data.r.ready,
-      data.b.ready
-    );
-
-    data.b.id = mem->b_id();
-    data.b.resp = mem->b_resp(); 
-    data.b.valid = mem->b_valid();
-
-    data.r.id = mem->r_id();
-    data.r.resp = mem->r_resp();
-    data.r.last = mem->r_last();
-    data.r.valid = mem->r_valid();
-    if (data.r.fire()) {
-      data_t* r_data = (data_t*) mem->r_data();
-      for (size_t i = 0 ; i < MEM_CHUNKS ; i++) {
-        data.r.data[i] = r_data[i];
-      }
+    data.r.ready,
+    data.b.ready
+  );
+
+  data.b.id = mem->b_id();
+  data.b.resp = mem->b_resp();
+  data.b.valid = mem->b_valid();
+
+  data.r.id = mem->r_id();
+  data.r.resp = mem->r_resp();
+  data.r.last = mem->r_last();
+  data.r.valid = mem->r_valid();
+  if (data.r.fire()) {
+    data_t* r_data = (data_t*) mem->r_data();
+    for (size_t i = 0 ; i < MEM_CHUNKS ; i++) {
+      data.r.data[i] = r_data[i];
     }
+  }
+}
 
+// A stalled target is granted the cycles until the model's next response
+// can fall due. The widget cuts the delta short if the target makes a
+// request in it, and the model is stepped over the cycles the target ran
+// once it stalls again. Beats the model has yet to take would change its
+// timing, so it stays in lockstep while any wait.
+size_t sim_mem_t::grant() {
+  if (!_stall) return 0;
+  if ((data.ar.valid && !data.ar.fire()) || (data.aw.valid && !data.aw.fire()) ||
+      (data.w.valid && !data.w.fire()) ||
+      !ar_beats.empty() || !aw_beats.empty() || !w_beats.empty()) return 1;
+  // Deltas are 32 bits in the widget
+  granted = std::min<uint64_t>(
+    std::min(mem->run_ahead(), max_run_ahead), UINT32_MAX);
+  return granted;
+}
+
+void sim_mem_t::end_tick() {
+  const size_t cycles = grant();
+  if (use_dma()) {
+    this->send_dma(data, cycles);
+  } else {
     this->send(data);
+    if (cycles) this->delta(cycles);
+  }
+  if (data.r.fire() && data.r.last) num_reads--;
+  if (data.b.fire()) num_writes--;
+}
 
-    if (_stall) this->delta(1);
-    if (data.r.fire() && data.r.last) num_reads--;
-    if (data.b.fire()) num_writes--;
+void sim_mem_t::tick() {
+  MMIO_PROFILE_PHASE(MMIO_PHASE_SIM_MEM);
+  if (begin_tick()) {
+    tick_model();
+    end_tick();
   }
-#endif
 }
 
 void sim_mem_t::write_mem(uint64_t addr, void* data) {
-#ifdef NASTIWIDGET_0
-  mem->write(addr, (uint8_t*)data, -1, mem->get_word_size());
-#endif
+  assert((addr / SIM_MEM_LINE_SIZE) % nchannels == channel);
+  mem->write(local_addr(addr), (uint8_t*)data, -1, mem->get_word_size());
+}
+
+// Model steps handed to the channel workers
+enum sim_mem_work_t { SIM_MEM_WORK_TICK = 1, SIM_MEM_WORK_EXIT };
+
+struct sim_mem_worker_t {
+  spsc_ring_t<uint32_t, 16> req;
+  spsc_ring_t<uint32_t, 16> resp;
+  sim_mem_t* channel;
+  pthread_t thread;
+};
+
+// Static so that the rings start zeroed
+static sim_mem_worker_t sim_mem_workers[SIM_MEM_MAX_CHANNELS];
+
+static void* sim_mem_worker_main(void* arg) {
+  sim_mem_worker_t* w = (sim_mem_worker_t*) arg;
+  while (true) {
+    uint32_t work;
+    w->req.wait([w] { return !w->req.empty(); });
+    w->req.pop(&work, 1);
+    if (work == SIM_MEM_WORK_EXIT) return NULL;
+    w->channel->tick_model();
+    w->resp.push(&work, 1);
+  }
+}
+
+sim_mem_channels_t::~sim_mem_channels_t() {
+  stop_workers();
+  for (auto channel: channels) delete channel;
+}
+
+void sim_mem_channels_t::init(int argc, char** argv) {
+  std::vector<std::string> args(argv + 1, argv + argc);
+  const char* loadmem = NULL;
+  std::string image, save_image;
+  for (auto &arg: args) {
+    if (arg.find("+loadmem=") == 0) {
+      loadmem = arg.c_str() + 9;
+    }
+    mm_parse_image(arg, &image, &save_image);
+    if (arg.find("+mem-threads") == 0) {
+      threaded = true;
+    }
+  }
+  void* mems[SIM_MEM_MAX_CHANNELS];
+  for (size_t i = 0 ; i < channels.size() ; i++) {
+    channels[i]->init(argc, argv);
+    mems[i] = channels[i]->get_data();
+  }
+  active.resize(channels.size());
+  if (!image.empty()) {
+    fprintf(stderr, "[mem image] %s\n", image.c_str());
+  } else if (loadmem) {
+    fprintf(stderr, "[sw loadmem] %s\n", loadmem);
+    ::load_mem(mems, loadmem, SIM_MEM_LINE_SIZE, channels.size(),
+               channels[0]->get_size() * channels.size());
+  }
+  if (!save_image.empty()) {
+    bool ok = true;
+    for (size_t i = 0 ; ok && i < channels.size() ; i++) {
+      ok = channels[i]->save_image(save_image, i * channels[i]->get_size());
+    }
+    if (ok) fprintf(stderr, "[mem image] saved %s\n", save_image.c_str());
+  }
+  if (threaded && channels.size() > 1) start_workers();
+}
+
+void sim_mem_channels_t::start_workers() {
+  for (size_t i = 1 ; i < channels.size() ; i++) {
+    sim_mem_worker_t* w = &sim_mem_workers[i];
+    w->channel = channels[i];
+    if (pthread_create(&w->thread, NULL, sim_mem_worker_main, w)) {
+      fprintf(stderr, "Cannot start the worker for memory channel %zu\n", i);
+      abort();
+    }
+  }
+}
+
+void sim_mem_channels_t::stop_workers() {
+  if (!threaded || channels.size() < 2) return;
+  const uint32_t work = SIM_MEM_WORK_EXIT;
+  for (size_t i = 1 ; i < channels.size() ; i++) {
+    sim_mem_workers[i].req.push(&work, 1);
+    pthread_join(sim_mem_workers[i].thread, NULL);
+  }
+  threaded = false;
+}
+
+void sim_mem_channels_t::tick() {
+  MMIO_PROFILE_PHASE(MMIO_PHASE_SIM_MEM);
+  for (size_t i = 0 ; i < channels.size() ; i++) {
+    active[i] = channels[i]->begin_tick();
+  }
+  if (threaded && channels.size() > 1) {
+    const uint32_t work = SIM_MEM_WORK_TICK;
+    for (size_t i = 1 ; i < channels.size() ; i++) {
+      if (active[i]) sim_mem_workers[i].req.push(&work, 1);
+    }
+    if (active[0]) channels[0]->tick_model();
+    for (size_t i = 1 ; i < channels.size() ; i++) {
+      if (!active[i]) continue;
+      sim_mem_worker_t* w = &sim_mem_workers[i];
+      uint32_t done;
+      w->resp.wait([w] { return !w->resp.empty(); });
+      w->resp.pop(&done, 1);
+    }
+  } else {
+    for (size_t i = 0 ; i < channels.size() ; i++) {
+      if (active[i]) channels[i]->tick_model();
+    }
+  }
+  for (size_t i = 0 ; i < channels.size() ; i++) {
+    if (active[i]) channels[i]->end_tick();
+  }
+}
+
+bool sim_mem_channels_t::done() {
+  bool _done = true;
+  for (auto channel: channels) _done &= channel->done();
+  return _done;
+}
+
+void sim_mem_channels_t::write_mem(uint64_t addr, void* data) {
+  channels[(addr / SIM_MEM_LINE_SIZE) % channels.size()]->write_mem(addr, data);
 }
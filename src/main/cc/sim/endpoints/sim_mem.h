@@ -4,8 +4,11 @@
 #define __SIM_MEM_H
 
 #include "endpoint.h"
+#include "address_map.h"
 #include "mm.h"
 #include "mm_dramsim2.h"
+#include <deque>
+#include <vector>
 
 
 static const size_t MEM_CHUNKS = MEM_DATA_BITS / (8 * sizeof(data_t));
@@ -46,10 +49,55 @@ struct sim_mem_data_t {
   } b;
 };
 
+// Channel-interleaved host memory: line i of the target address space
+// lives in channel i % nchannels, as load_mem lays out images
+#define SIM_MEM_MAX_CHANNELS 4
+#define SIM_MEM_LINE_SIZE 64
+
+// Registers of the NastiWidget_<n> driving a channel, named as generated
+#define SIM_MEM_ADDR_MAP(w) AddressMap( \
+  w ## _R_num_registers, (const unsigned int*) w ## _R_addrs, (const char* const*) w ## _R_names, \
+  w ## _W_num_registers, (const unsigned int*) w ## _W_addrs, (const char* const*) w ## _W_names)
+
+// On platforms with a DMA channel, NastiWidget_<n> also answers at
+// NASTIWIDGET_<n>_DMA_ADDR, where a host step takes a pull of the request
+// beats the target has issued since the last one and a push of the
+// responses when the transport has DMA. Records are in 64-bit words:
+//  request:  the "valid" register bits, which flag the beats of the record
+//            (4: AR, 3: AW, 2: W) and give the R and B ready bits, with
+//            the "delta_left" register in bits 63:32,
+//            AR addr, AR id/size/len, AW addr, AW id/size/len,
+//            W strb/last, W data
+//  response: the "ready" register with the delta in bits 63:32,
+//            R id/resp/last, B id/resp, R data
+#define SIM_MEM_NO_DMA (~(size_t)0)
+#ifndef NASTIWIDGET_0_DMA_ADDR
+#define NASTIWIDGET_0_DMA_ADDR SIM_MEM_NO_DMA
+#endif
+#ifndef NASTIWIDGET_1_DMA_ADDR
+#define NASTIWIDGET_1_DMA_ADDR SIM_MEM_NO_DMA
+#endif
+#ifndef NASTIWIDGET_2_DMA_ADDR
+#define NASTIWIDGET_2_DMA_ADDR SIM_MEM_NO_DMA
+#endif
+#ifndef NASTIWIDGET_3_DMA_ADDR
+#define NASTIWIDGET_3_DMA_ADDR SIM_MEM_NO_DMA
+#endif
+static const size_t SIM_MEM_DATA_WORDS = (MEM_DATA_BITS - 1) / 64 + 1;
+static const size_t SIM_MEM_REQ_WORDS = 6 + SIM_MEM_DATA_WORDS;
+static const size_t SIM_MEM_RESP_WORDS = 3 + SIM_MEM_DATA_WORDS;
+// Request records pulled at once. Fewer than the widget queues are left
+// for the next pull.
+#define SIM_MEM_DMA_RECORDS 32
+
+// Host memory model behind one NastiWidget
 class sim_mem_t: public endpoint_t
 {
 public:
-  sim_mem_t(simif_t* s, int argc, char** argv);
+  sim_mem_t(simif_t* s, AddressMap addr_map, size_t done_bit, size_t pending_bit,
+            size_t channel = 0, size_t nchannels = 1, size_t dma_addr = SIM_MEM_NO_DMA);
+  ~sim_mem_t();
+  virtual void init(int argc, char** argv);
   bool stall();
   void delta(size_t t);
   void send(sim_mem_data_t& data);
@@ -58,10 +106,92 @@ public:
   virtual void tick();
   virtual bool done();
 
+  // tick() split so that the model can run apart from the widget accesses:
+  // begin_tick() fetches the channels and returns whether the model needs to
+  // run, tick_model() steps it and end_tick() returns its outputs
+  bool begin_tick();
+  void tick_model();
+  void end_tick();
+
   void write_mem(uint64_t addr, void* data);
+  void* get_data() { return mem->get_data(); }
+  size_t get_size() { return mem->get_size(); }
+  bool save_image(const std::string& filename, size_t offset) {
+    return mem->save_image(filename, offset);
+  }
 
 private:
   mm_t* mem;
+  const size_t done_bit;
+  const size_t pending_bit;
+  const size_t channel;
+  const size_t nchannels;
+  struct {
+    size_t ar_bits, ar_addr, ar_meta;
+    size_t aw_bits, aw_addr, aw_meta;
+    size_t w_meta, w_data[MEM_CHUNKS];
+    size_t r_meta, r_data[MEM_CHUNKS];
+    size_t b_meta, valid, ready, delta, delta_left;
+    bool ar_packed, aw_packed;
+  } regs;
+  const size_t dma_addr;
+  // Pinned record buffers, only allocated once the transport is found to
+  // have DMA; the registers are used otherwise
+  char* dma_req;
+  char* dma_resp;
+  // The beats in the widget's AR, AW and W buffers as pulled, which leave
+  // them on the ready bits pushed back
+  std::deque<decltype(sim_mem_data_t::ar)> ar_beats, aw_beats;
+  std::deque<decltype(sim_mem_data_t::w)> w_beats;
+
+  inline bool use_dma() const { return dma_req != NULL; }
+  size_t pull_requests(sim_mem_data_t& data);
+  void recv_dma(sim_mem_data_t& data);
+  void send_dma(sim_mem_data_t& data, size_t delta);
+  size_t grant();
+
+  sim_mem_data_t data;
+  bool _stall;
+  // Cap of a delta from the model's run_ahead(), set by +mm-run-ahead.
+  // There is none by default, as the widget cuts a delta short when the
+  // target makes a request.
+  uint64_t max_run_ahead;
+  // The delta granted last, which the model has yet to be stepped over
+  uint64_t granted;
+  size_t num_reads;
+  size_t num_writes;
+
+  // Offset in this channel of a target address it owns
+  inline uint64_t local_addr(uint64_t addr) {
+    return (addr / SIM_MEM_LINE_SIZE / nchannels) * SIM_MEM_LINE_SIZE +
+           (addr % SIM_MEM_LINE_SIZE);
+  }
+};
+
+// The channels as a single endpoint. Widget accesses stay on the calling
+// thread, batched across channels; with +mem-threads the models of the
+// other channels step on worker threads while this one steps channel 0.
+class sim_mem_channels_t: public endpoint_t
+{
+public:
+  sim_mem_channels_t(simif_t* s): endpoint_t(s), threaded(false) { }
+  ~sim_mem_channels_t();
+  void add_channel(sim_mem_t* channel) { channels.push_back(channel); }
+  size_t size() const { return channels.size(); }
+
+  virtual void init(int argc, char** argv);
+  virtual void tick();
+  virtual bool done();
+
+  // Routes a line of a loaded program to the channel that owns it
+  void write_mem(uint64_t addr, void* data);
+
+private:
+  std::vector<sim_mem_t*> channels;
+  std::vector<bool> active;
+  bool threaded;
+  void start_workers();
+  void stop_workers();
 };
 
 #endif // __SIM_MEM_H
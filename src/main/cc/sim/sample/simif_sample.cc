@@ -12,6 +12,7 @@ extern counters_t* counters;
 #endif
 
 void simif_t::init_sampling(int argc, char** argv) {
+  MMIO_PROFILE_PHASE(MMIO_PHASE_SAMPLING);
   // Read mapping files
   sample_t::init_chains(std::string(TARGET_NAME) + ".chain");
 
@@ -52,18 +53,20 @@ void simif_t::init_sampling(int argc, char** argv) {
   for (size_t i = 0 ; i < sample_num ; i++) snapshots[i] = NULL;
 
   // flush output traces by sim reset
+  data_t discard;
   for (size_t k = 0 ; k < OUT_TR_SIZE ; k++) {
     size_t addr = OUT_TR_ADDRS[k];
     size_t chunk = OUT_TR_CHUNKS[k];
-    for (size_t off = 0 ; off < chunk ; off++) read(addr+off);
+    for (size_t off = 0 ; off < chunk ; off++) queue_read(addr+off, &discard);
   }
   for (size_t id = 0 ; id < OUT_TR_READY_VALID_SIZE ; id++) {
-    read((size_t)OUT_TR_READY_ADDRS[id]);
-    read((size_t)OUT_TR_VALID_ADDRS[id]);
+    queue_read((size_t)OUT_TR_READY_ADDRS[id], &discard);
+    queue_read((size_t)OUT_TR_VALID_ADDRS[id], &discard);
     size_t bits_addr = (size_t)OUT_TR_BITS_ADDRS[id];
     size_t bits_chunk = (size_t)OUT_TR_BITS_CHUNKS[id];
-    for (size_t off = 0 ; off < bits_chunk ; off++) read(bits_addr + off);
+    for (size_t off = 0 ; off < bits_chunk ; off++) queue_read(bits_addr + off, &discard);
   }
+  flush();
   if (profile) sim_start_time = timestamp();
 }
 
@@ -98,38 +101,54 @@ void simif_t::finish_sampling() {
 
 static const size_t data_t_chunks = sizeof(data_t) / sizeof(uint32_t);
 
+// Number of trace registers read per traced cycle
+static size_t trace_chunks() {
+  size_t chunks = 0;
+  for (size_t id = 0 ; id < IN_TR_SIZE ; id++) {
+    chunks += IN_TR_CHUNKS[id];
+  }
+  for (size_t id = 0 ; id < IN_TR_READY_VALID_SIZE ; id++) {
+    chunks += 2 + (size_t)IN_TR_BITS_CHUNKS[id];
+  }
+  for (size_t id = 0 ; id < OUT_TR_SIZE ; id++) {
+    chunks += OUT_TR_CHUNKS[id];
+  }
+  for (size_t id = 0 ; id < OUT_TR_READY_VALID_SIZE ; id++) {
+    chunks += 2 + (size_t)OUT_TR_BITS_CHUNKS[id];
+  }
+  return chunks;
+}
+
 void simif_t::read_traces(snapshot_t *snapshot) {
+  MMIO_PROFILE_PHASE(MMIO_PHASE_SAMPLING);
   size_t trace_size = std::min(trace_count, tracelen);
   if (snapshot) snapshot->trace_size = trace_size;
+
+  // Fetch the whole trace buffer in one batch
+  std::vector<data_t> buf(trace_size * trace_chunks());
+  data_t* data = buf.data();
   for (size_t i = 0 ; i < trace_size ; i++) {
     // wire input traces from FPGA
     for (size_t id = 0 ; id < IN_TR_SIZE ; id++) {
       size_t addr = IN_TR_ADDRS[id];
       size_t chunk = IN_TR_CHUNKS[id];
       for (size_t off = 0 ; off < chunk ; off++) {
-        data_t data = read(addr+off);
-        if (snapshot) snapshot->trace.push_back(data);
+        queue_read(addr+off, data++);
       }
     }
 
     // ready valid input traces from FPGA
     for (size_t id = 0 ; id < IN_TR_READY_VALID_SIZE ; id++) {
-      size_t valid_addr = (size_t)IN_TR_VALID_ADDRS[id];
-      data_t valid_data = read(valid_addr);
-      if (snapshot) snapshot->trace.push_back(valid_data);
+      queue_read((size_t)IN_TR_VALID_ADDRS[id], data++);
       size_t bits_addr = (size_t)IN_TR_BITS_ADDRS[id];
       size_t bits_chunk = (size_t)IN_TR_BITS_CHUNKS[id];
       for (size_t off = 0 ; off < bits_chunk ; off++) {
-        data_t data = read(bits_addr + off);
-        // We need all input traces
-        if (snapshot) snapshot->trace.push_back(data);
+        queue_read(bits_addr + off, data++);
       }
     }
 
     for (size_t id = 0 ; id < OUT_TR_READY_VALID_SIZE ; id++) {
-      size_t ready_addr = (size_t)OUT_TR_READY_ADDRS[id];
-      data_t ready_data = read(ready_addr);
-      if (snapshot) snapshot->trace.push_back(ready_data);
+      queue_read((size_t)OUT_TR_READY_ADDRS[id], data++);
     }
 
     // wire output traces from FPGA
@@ -137,55 +156,94 @@ void simif_t::read_traces(snapshot_t *snapshot) {
       size_t addr = OUT_TR_ADDRS[id];
       size_t chunk = OUT_TR_CHUNKS[id];
       for (size_t off = 0 ; off < chunk ; off++) {
-        data_t data = read(addr+off);
-        if (snapshot && i > 0) snapshot->trace.push_back(data);
+        queue_read(addr+off, data++);
       }
     }
 
     // ready valid output traces from FPGA
     for (size_t id = 0 ; id < OUT_TR_READY_VALID_SIZE ; id++) {
-      size_t valid_addr = (size_t)OUT_TR_VALID_ADDRS[id];
-      data_t valid_data = read(valid_addr);
-      if (snapshot) snapshot->trace.push_back(valid_data);
+      queue_read((size_t)OUT_TR_VALID_ADDRS[id], data++);
       size_t bits_addr = (size_t)OUT_TR_BITS_ADDRS[id];
       size_t bits_chunk = (size_t)OUT_TR_BITS_CHUNKS[id];
       for (size_t off = 0 ; off < bits_chunk ; off++) {
-        data_t data = read(bits_addr + off);
+        queue_read(bits_addr + off, data++);
+      }
+    }
+    for (size_t id = 0 ; id < IN_TR_READY_VALID_SIZE ; id++) {
+      queue_read((size_t)IN_TR_READY_ADDRS[id], data++);
+    }
+  }
+  flush();
+  if (!snapshot) return;
+
+  // Unpack the traces in the order they were read
+  data = buf.data();
+  for (size_t i = 0 ; i < trace_size ; i++) {
+    for (size_t id = 0 ; id < IN_TR_SIZE ; id++) {
+      for (size_t off = 0 ; off < IN_TR_CHUNKS[id] ; off++) {
+        snapshot->trace.push_back(*data++);
+      }
+    }
+
+    for (size_t id = 0 ; id < IN_TR_READY_VALID_SIZE ; id++) {
+      snapshot->trace.push_back(*data++);
+      for (size_t off = 0 ; off < (size_t)IN_TR_BITS_CHUNKS[id] ; off++) {
+        // We need all input traces
+        snapshot->trace.push_back(*data++);
+      }
+    }
+
+    for (size_t id = 0 ; id < OUT_TR_READY_VALID_SIZE ; id++) {
+      snapshot->trace.push_back(*data++);
+    }
+
+    for (size_t id = 0 ; id < OUT_TR_SIZE ; id++) {
+      for (size_t off = 0 ; off < OUT_TR_CHUNKS[id] ; off++) {
+        data_t value = *data++;
+        if (i > 0) snapshot->trace.push_back(value);
+      }
+    }
+
+    for (size_t id = 0 ; id < OUT_TR_READY_VALID_SIZE ; id++) {
+      data_t valid_data = *data++;
+      snapshot->trace.push_back(valid_data);
+      for (size_t off = 0 ; off < (size_t)OUT_TR_BITS_CHUNKS[id] ; off++) {
+        data_t value = *data++;
         // Check only when valid is up
-        if (snapshot && valid_data) snapshot->trace.push_back(data);
+        if (valid_data) snapshot->trace.push_back(value);
       }
     }
     for (size_t id = 0 ; id < IN_TR_READY_VALID_SIZE ; id++) {
-      size_t ready_addr = (size_t)IN_TR_READY_ADDRS[id];
-      data_t ready_data = read(ready_addr);
-      if (snapshot) snapshot->trace.push_back(ready_data);
+      snapshot->trace.push_back(*data++);
     }
   }
 }
 
 void simif_t::read_snapshot(bool load) {
+  MMIO_PROFILE_PHASE(MMIO_PHASE_SAMPLING);
   snapshot_t* snapshot = load ? NULL : snapshots[last_snapshot_id];
   if (snapshot) snapshot->cycle = cycles();
+  data_t discard;
   size_t state_idx = 0;
   for (size_t t = 0 ; t < CHAIN_NUM ; t++) {
     CHAIN_TYPE type = static_cast<CHAIN_TYPE>(t);
     const size_t chain_loop = sample_t::get_chain_loop(type);
     const size_t chain_len  = sample_t::get_chain_len(type);
     for (size_t k = 0 ; k < chain_loop ; k++) {
-      if (!load) write(CHAIN_COPY_ADDR[t], 1);
+      if (!load) queue_write(CHAIN_COPY_ADDR[t], 1);
       for (size_t j = 0 ; j < chain_len ; j++) {
         // TODO: write arbitrary values
-        if (load) write(CHAIN_IN_ADDR[t], 0);
-        data_t value = read(CHAIN_OUT_ADDR[t]);
-        if (!load) snapshot->state[state_idx] = value;
+        if (load) queue_write(CHAIN_IN_ADDR[t], 0);
+        queue_read(CHAIN_OUT_ADDR[t], load ? &discard : snapshot->state + state_idx);
         state_idx++;
       }
       if (load) {
-        write(CHAIN_LOAD_ADDR[t], 1);
-        write(CHAIN_COPY_ADDR[t], 1); // to generate new addrs
+        queue_write(CHAIN_LOAD_ADDR[t], 1);
+        queue_write(CHAIN_COPY_ADDR[t], 1); // to generate new addrs
       }
     }
   }
+  flush();
   assert(state_idx == snapshot_t::get_state_size());
 }
 
@@ -1,10 +1,13 @@
 // See LICENSE for license details.
 
 #include "simif.h"
-#include <fstream>
 #include <algorithm>
+#include <unistd.h>
+#include <sys/mman.h>
 #include "endpoints/counters.h"
 #include "endpoints/fpga_memory_model.h"
+#include "endpoints/sim_mem.h"
+#include "utils/mem_image.h"
 
 midas_time_t timestamp(){
   struct timeval tv;
@@ -24,13 +27,43 @@ simif_t::simif_t() {
   pass = true;
   t = 0;
   fail_t = 0;
+  status = 0;
+  dma_tag = 0;
+  profile_interval = 0;
   seed = time(NULL); // FIXME: better initail seed?
 #ifdef ENABLE_COUNTERS
   counters = new counters_t(this);
   endpoints.push_back(counters);
 #endif
 #ifdef NASTIWIDGET_0
-  endpoints.push_back(new sim_mem_t(this, argc, argv));
+  // One channel per NastiWidget, up to SIM_MEM_MAX_CHANNELS
+  const size_t mem_channels = 1
+#ifdef NASTIWIDGET_1
+    + 1
+#endif
+#ifdef NASTIWIDGET_2
+    + 1
+#endif
+#ifdef NASTIWIDGET_3
+    + 1
+#endif
+    ;
+  sim_mem_channels_t* sim_mem = new sim_mem_channels_t(this);
+#define SIM_MEM_CHANNEL(w, i) sim_mem->add_channel(new sim_mem_t( \
+    this, SIM_MEM_ADDR_MAP(w), w ## _DONE_BIT, w ## _PENDING_BIT, i, mem_channels, \
+    w ## _DMA_ADDR));
+  SIM_MEM_CHANNEL(NASTIWIDGET_0, 0)
+#ifdef NASTIWIDGET_1
+  SIM_MEM_CHANNEL(NASTIWIDGET_1, 1)
+#endif
+#ifdef NASTIWIDGET_2
+  SIM_MEM_CHANNEL(NASTIWIDGET_2, 2)
+#endif
+#ifdef NASTIWIDGET_3
+  SIM_MEM_CHANNEL(NASTIWIDGET_3, 3)
+#endif
+#undef SIM_MEM_CHANNEL
+  endpoints.push_back(sim_mem);
 #endif
 #ifdef MEMMODEL_0
   fpga_models.push_back(new FpgaMemoryModel(
@@ -61,9 +94,21 @@ void simif_t::init(int argc, char** argv, bool log) {
     if (arg.find("+loadmem=") == 0) {
       loadmem = arg.c_str() + 9;
     }
+    if (arg.find("+mem-image=") == 0) {
+      // The image already holds the loaded memory
+      fastloadmem = true;
+    }
     if (arg.find("+seed=") == 0) {
       seed = strtoll(arg.c_str() + 6, NULL, 10);
     }
+    if (arg.find("+profile-interval=") == 0) {
+      profile_interval = strtoull(arg.c_str() + 18, NULL, 10);
+    }
+#ifdef ENABLE_MMIO_PROFILE
+    if (arg.find("+mmio-profile=") == 0) {
+      mmio_profile_file = arg.c_str() + 14;
+    }
+#endif
   }
   gen.seed(seed);
   fprintf(stderr, "random min: 0x%llx, random max: 0x%llx\n", gen.min(), gen.max());
@@ -120,53 +165,34 @@ int simif_t::finish() {
   if (!pass) { fprintf(stderr, " at cycle %llu", (unsigned long long)fail_t); }
   fprintf(stderr, "\nSEED: %ld\n", seed);
 
+#ifdef ENABLE_MMIO_PROFILE
+  mmio_profile.print(stderr);
+  if (!mmio_profile_file.empty()) mmio_profile.dump_json(mmio_profile_file.c_str());
+#endif
+
   return pass ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
-static const size_t data_t_chunks = sizeof(data_t) / sizeof(uint32_t);
-
 void simif_t::poke(size_t id, mpz_t& value) {
-  if (log) {
-    char* v_str = mpz_get_str(NULL, 16, value);
-    fprintf(stderr, "* POKE %s.%s <- 0x%s *\n", TARGET_NAME, INPUT_NAMES[id], v_str);
-    free(v_str);
-  }
-  size_t size;
-  data_t* data = (data_t*)mpz_export(NULL, &size, -1, sizeof(data_t), 0, 0, value);
-  for (size_t i = 0 ; i < INPUT_CHUNKS[id] ; i++) {
-    write(INPUT_ADDRS[id]+i, i < size ? data[i] : 0);
-  }
+  bits<INPUT_MAX_CHUNKS> data;
+  data.from_mpz(value);
+  poke(id, data);
 }
 
 void simif_t::peek(size_t id, mpz_t& value) {
-  const size_t size = (const size_t)OUTPUT_CHUNKS[id];
-  data_t data[size];
-  for (size_t i = 0 ; i < size ; i++) {
-    data[i] = read((size_t)OUTPUT_ADDRS[id]+i);
-  }
-  mpz_import(value, size, -1, sizeof(data_t), 0, 0, data);
-  if (log) {
-    char* v_str = mpz_get_str(NULL, 16, value);
-    fprintf(stderr, "* PEEK %s.%s -> 0x%s *\n", TARGET_NAME, (const char*)OUTPUT_NAMES[id], v_str);
-    free(v_str);
-  }
+  bits<OUTPUT_MAX_CHUNKS> data;
+  peek(id, data);
+  data.to_mpz(value);
 }
 
 bool simif_t::expect(size_t id, mpz_t& expected) {
-  mpz_t value;
-  mpz_init(value);
-  peek(id, value);
-  bool pass = mpz_cmp(value, expected) == 0;
-  if (log) {
-    char* v_str = mpz_get_str(NULL, 16, value);
-    char* e_str = mpz_get_str(NULL, 16, expected);
-    fprintf(stderr, "* EXPECT %s.%s -> 0x%s ?= 0x%s : %s\n",
-      TARGET_NAME, (const char*)OUTPUT_NAMES[id], v_str, e_str, pass ? "PASS" : "FAIL");
-    free(v_str);
-    free(e_str);
-  }
-  mpz_clear(value);
-  return expect(pass, NULL);
+  bits<OUTPUT_MAX_CHUNKS> data;
+  // Values wider than the port can never match
+  if (!data.from_mpz(expected)) {
+    peek(id, data);
+    return expect(false, NULL);
+  }
+  return expect(id, data);
 }
 
 void simif_t::step(int n, bool blocking) {
@@ -181,13 +207,43 @@ void simif_t::step(int n, bool blocking) {
 #endif
   // take steps
   if (log) fprintf(stderr, "* STEP %d -> %llu *\n", n, (unsigned long long)(t + n));
-  take_steps(n, blocking);
-  t += n;
+  const uint64_t end = t + n;
+  if (!blocking) {
+    take_steps(n, false);
+    t = end;
+    return;
+  }
+  // Steps are split where the models act on a stopped target: at
+  // multiples of the profile interval, and at the cycles they ask for
+  model_events();
+  while (t < end) {
+    uint64_t stop = end;
+    if (profile_interval) stop = std::min(stop, t - t % profile_interval + profile_interval);
+    for (auto& fpga_model: fpga_models) {
+      const uint64_t event = fpga_model->next_event();
+      if (event > t) stop = std::min(stop, event);
+    }
+    take_steps(stop - t, true);
+    t = stop;
+    if (profile_interval && t % profile_interval == 0) {
+      for (auto& fpga_model: fpga_models) {
+        fpga_model->profile();
+      }
+    }
+    model_events();
+  }
+}
+
+void simif_t::model_events() {
+  for (auto& fpga_model: fpga_models) {
+    if (fpga_model->next_event() <= t) fpga_model->handle_event();
+  }
 }
 
 void simif_t::take_steps(size_t n, bool blocking) {
   write(MASTER(STEP), n);
   do {
+    // Endpoints only act on what the last status read flagged
     for (auto& endpoint: endpoints) {
       endpoint->tick();
     }
@@ -195,57 +251,132 @@ void simif_t::take_steps(size_t n, bool blocking) {
 }
 
 bool simif_t::done() {
-  bool _done = true;
+  // A single read reports the state of every endpoint
+  status = read(MASTER(STATUS));
+  bool _done = !(status & STATUS_PENDING_MASK);
   for (auto& endpoint: endpoints) {
     _done &= endpoint->done();
   }
-  return _done && read(MASTER(DONE));
+  return _done && ((status >> MASTER(DONE_BIT)) & 0x1);
+}
+
+void simif_t::flush() {
+  for (auto& op: batch) {
+    if (op.dst) {
+      *op.dst = read(op.addr);
+    } else {
+      write(op.addr, op.data);
+    }
+  }
+  batch.clear();
+}
+
+char* simif_t::dma_alloc(size_t size) {
+  static const size_t page_size = sysconf(_SC_PAGESIZE);
+  void* data;
+  size = (size + page_size - 1) & ~(page_size - 1);
+  if (posix_memalign(&data, page_size, size)) return NULL;
+  if (mlock(data, size)) {
+    static bool warned = false;
+    if (!warned) fprintf(stderr, "Cannot pin DMA buffers, check ulimit -l\n");
+    warned = true;
+  }
+  return (char*)data;
+}
+
+void simif_t::dma_free(char* data, size_t size) {
+  static const size_t page_size = sysconf(_SC_PAGESIZE);
+  munlock(data, (size + page_size - 1) & ~(page_size - 1));
+  free(data);
+}
+
+int simif_t::pull_async(size_t addr, char* data, size_t size) {
+  int tag = dma_tag++;
+  dma_done[tag] = pull(addr, data, size);
+  return tag;
+}
+
+int simif_t::push_async(size_t addr, char* data, size_t size) {
+  int tag = dma_tag++;
+  dma_done[tag] = push(addr, data, size);
+  return tag;
+}
+
+ssize_t simif_t::dma_wait(int tag) {
+  auto it = dma_done.find(tag);
+  assert(it != dma_done.end());
+  ssize_t size = it->second;
+  dma_done.erase(it);
+  return size;
 }
 
 #ifdef LOADMEM
+// Beats queued per flush while loading an image
+#define LOADMEM_FLUSH_BEATS 256
+
 void simif_t::load_mem(std::string filename) {
+  MMIO_PROFILE_PHASE(MMIO_PHASE_LOADMEM);
   fprintf(stdout, "[loadmem] start loading\n");
-  std::ifstream file(filename.c_str());
-  if (!file) {
-    fprintf(stderr, "Cannot open %s\n", filename.c_str());
-    exit(EXIT_FAILURE);
-  }
-  const size_t chunk = MEM_DATA_BITS / 4;
-  size_t addr = 0;
-  std::string line;
-  mpz_t data;
-  mpz_init(data);
-  while (std::getline(file, line)) {
-    assert(line.length() % chunk == 0);
-    for (int j = line.length() - chunk ; j >= 0 ; j -= chunk) {
-      mpz_set_str(data, line.substr(j, chunk).c_str(), 16);
-      write_mem(addr, data);
-      addr += chunk / 2;
+  const size_t beat = MEM_DATA_BITS / 8;
+  mem_image_t image(filename.c_str());
+  // Widget accesses are serial, so decode on this thread only
+  image.load([&](uint64_t addr, const char* src, size_t size) {
+    size_t queued = 0;
+    while (size) {
+      const size_t off = addr % beat;
+      const size_t n = std::min(size, beat - off);
+      mem_bits_t data;
+      if (n < beat) {
+        // Unaligned ends of ELF segments keep the rest of their beat
+        read_mem(addr - off, data);
+        memcpy((char*)data.data() + off, src, n);
+      } else {
+        data = mem_bits_t(src, beat);
+      }
+      queue_write_mem(addr - off, data);
+      if (++queued % LOADMEM_FLUSH_BEATS == 0) flush();
+      addr += n;
+      src += n;
+      size -= n;
     }
-  }
-  mpz_clear(data);
-  file.close();
+    flush();
+  }, 1);
   fprintf(stdout, "[loadmem] done\n");
 }
 
-void simif_t::read_mem(size_t addr, mpz_t& value) {
-  write(LOADMEM_R_ADDRESS_H, addr >> 32);
-  write(LOADMEM_R_ADDRESS_L, addr & ((1ULL << 32) - 1));
-  const size_t size = MEM_DATA_CHUNK;
-  data_t data[size];
-  for (size_t i = 0 ; i < size ; i++) {
-    data[i] = read(LOADMEM_R_DATA);
+void simif_t::read_mem(size_t addr, mem_bits_t& value) {
+  MMIO_PROFILE_PHASE(MMIO_PHASE_LOADMEM);
+  queue_write(LOADMEM_R_ADDRESS_H, addr >> 32);
+  queue_write(LOADMEM_R_ADDRESS_L, addr & ((1ULL << 32) - 1));
+  for (size_t i = 0 ; i < MEM_DATA_CHUNK ; i++) {
+    queue_read(LOADMEM_R_DATA, &value[i]);
   }
-  mpz_import(value, size, -1, sizeof(data_t), 0, 0, data);
+  flush();
 }
 
-void simif_t::write_mem(size_t addr, mpz_t& value) {
-  write(LOADMEM_W_ADDRESS_H, addr >> 32);
-  write(LOADMEM_W_ADDRESS_L, addr & ((1ULL << 32) - 1));
-  size_t size;
-  data_t* data = (data_t*)mpz_export(NULL, &size, -1, sizeof(data_t), 0, 0, value);
+void simif_t::queue_write_mem(size_t addr, const mem_bits_t& value) {
+  queue_write(LOADMEM_W_ADDRESS_H, addr >> 32);
+  queue_write(LOADMEM_W_ADDRESS_L, addr & ((1ULL << 32) - 1));
   for (size_t i = 0 ; i < MEM_DATA_CHUNK ; i++) {
-    write(LOADMEM_W_DATA, i < size ? data[i] : 0);
+    queue_write(LOADMEM_W_DATA, value[i]);
   }
 }
+
+void simif_t::write_mem(size_t addr, const mem_bits_t& value) {
+  MMIO_PROFILE_PHASE(MMIO_PHASE_LOADMEM);
+  queue_write_mem(addr, value);
+  flush();
+}
+
+void simif_t::read_mem(size_t addr, mpz_t& value) {
+  mem_bits_t data;
+  read_mem(addr, data);
+  data.to_mpz(value);
+}
+
+void simif_t::write_mem(size_t addr, mpz_t& value) {
+  mem_bits_t data;
+  data.from_mpz(value);
+  write_mem(addr, data);
+}
 #endif // LOADMEM
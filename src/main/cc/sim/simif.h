@@ -8,12 +8,15 @@
 #include <sstream>
 #include <map>
 #include <queue>
+#include <vector>
 #include <random>
 #ifdef ENABLE_SNAPSHOT
 #include "sample/sample.h"
 #endif
 #include <gmp.h>
 #include <sys/time.h>
+#include "utils/bits.h"
+#include "utils/mmio_profile.h"
 #define TIME_DIV_CONST 1000000.0
 typedef uint64_t midas_time_t;
 
@@ -27,6 +30,19 @@ typedef std::map< std::string, size_t >::const_iterator idmap_it_t;
 class endpoint_t;
 class FpgaModel;
 
+#ifdef LOADMEM
+typedef bits<MEM_DATA_CHUNK> mem_bits_t;
+#endif
+
+// A widget register access queued for simif_t::flush()
+struct mmio_op_t {
+  size_t addr;
+  data_t data; // value to write
+  data_t* dst; // destination of a read, NULL for a write
+  mmio_op_t(size_t addr_, data_t data_, data_t* dst_):
+    addr(addr_), data(data_), dst(dst_) { }
+};
+
 class simif_t
 {
   public:
@@ -41,11 +57,19 @@ class simif_t
     // random numbers
     uint64_t seed;
     std::mt19937_64 gen;
+    // packed endpoint status, refreshed once per host iteration by done()
+    data_t status;
 
-    std::vector<endpoint_t*> endpoints;
     std::vector<FpgaModel*> fpga_models;
+    // Cycles between FpgaModel::profile() calls, 0 for none
+    uint64_t profile_interval;
+#ifdef ENABLE_MMIO_PROFILE
+    std::string mmio_profile_file;
+#endif
 
     inline void take_steps(size_t n, bool blocking);
+    // Lets the FPGA models whose next event is due act on it
+    void model_events();
 #ifdef LOADMEM
     virtual void load_mem(std::string filename);
 #endif
@@ -59,12 +83,39 @@ class simif_t
     inline void add_endpoint(endpoint_t* e) {
       endpoints.push_back(e);
     }
+    inline data_t get_status() const { return status; }
 
     // Widget communication
     virtual void write(size_t addr, data_t data) = 0;
     virtual data_t read(size_t addr) = 0;
     virtual ssize_t pull(size_t addr, char *data, size_t size) = 0;
     virtual ssize_t push(size_t addr, char *data, size_t size) = 0;
+    // Whether pull/push reach the DMA ports of the widgets,
+    // which otherwise fall back on their registers
+    virtual bool has_dma() { return false; }
+
+    // Asynchronous bulk transfers
+    // Buffers from dma_alloc() are page aligned and pinned so that transports
+    // can DMA straight into them. pull_async/push_async start a transfer and
+    // return its tag; the buffer must stay untouched until dma_wait(tag)
+    // returns the transferred size (or -1). The default implementations are
+    // synchronous.
+    virtual char* dma_alloc(size_t size);
+    virtual void dma_free(char* data, size_t size);
+    virtual int pull_async(size_t addr, char* data, size_t size);
+    virtual int push_async(size_t addr, char* data, size_t size);
+    virtual ssize_t dma_wait(int tag);
+
+    // Batched widget communication
+    // Queued accesses are issued in order by flush(),
+    // and read values are only valid once it returns.
+    inline void queue_write(size_t addr, data_t data) {
+      batch.push_back(mmio_op_t(addr, data, NULL));
+    }
+    inline void queue_read(size_t addr, data_t* data) {
+      batch.push_back(mmio_op_t(addr, 0, data));
+    }
+    virtual void flush();
 
     inline void poke(size_t id, data_t value) {
       if (log) fprintf(stderr, "* POKE %s.%s <- 0x%x *\n",
@@ -94,11 +145,46 @@ class simif_t
       return pass;
     }
 
+    // Wide ports, N must cover INPUT_CHUNKS[id] / OUTPUT_CHUNKS[id]
+    template <size_t N> void poke(size_t id, const bits<N>& value) {
+      assert(INPUT_CHUNKS[id] <= N);
+      if (log) fprintf(stderr, "* POKE %s.%s <- 0x%s *\n",
+        TARGET_NAME, INPUT_NAMES[id], value.to_hex().c_str());
+      for (size_t i = 0 ; i < INPUT_CHUNKS[id] ; i++) {
+        queue_write(INPUT_ADDRS[id]+i, value[i]);
+      }
+      flush();
+    }
+
+    template <size_t N> void peek(size_t id, bits<N>& value) {
+      assert(OUTPUT_CHUNKS[id] <= N);
+      value.clear();
+      for (size_t i = 0 ; i < OUTPUT_CHUNKS[id] ; i++) {
+        queue_read((size_t)OUTPUT_ADDRS[id]+i, &value[i]);
+      }
+      flush();
+      if (log) fprintf(stderr, "* PEEK %s.%s -> 0x%s *\n",
+        TARGET_NAME, (const char*)OUTPUT_NAMES[id], value.to_hex().c_str());
+    }
+
+    template <size_t N> bool expect(size_t id, const bits<N>& expected) {
+      bits<N> value;
+      peek(id, value);
+      bool pass = value == expected;
+      if (log) fprintf(stderr, "* EXPECT %s.%s -> 0x%s ?= 0x%s : %s\n",
+        TARGET_NAME, (const char*)OUTPUT_NAMES[id],
+        value.to_hex().c_str(), expected.to_hex().c_str(), pass ? "PASS" : "FAIL");
+      return expect(pass, NULL);
+    }
+
+    // mpz_t compatibility wrappers over the bits APIs
     void poke(size_t id, mpz_t& value);
     void peek(size_t id, mpz_t& value);
     bool expect(size_t id, mpz_t& expected);
 
 #ifdef LOADMEM
+    void read_mem(size_t addr, mem_bits_t& value);
+    void write_mem(size_t addr, const mem_bits_t& value);
     void read_mem(size_t addr, mpz_t& value);
     void write_mem(size_t addr, mpz_t& value);
 #endif
@@ -109,6 +195,17 @@ class simif_t
     inline uint64_t cycles() { return t; }
     uint64_t rand_next(uint64_t limit) { return gen() % limit; }
 
+  protected:
+    std::vector<endpoint_t*> endpoints;
+    std::vector<mmio_op_t> batch;
+    // sizes of transfers completed before their dma_wait()
+    std::map<int, ssize_t> dma_done;
+    int dma_tag;
+#ifdef LOADMEM
+    // write_mem without the flush, so loads batch many beats per flush
+    void queue_write_mem(size_t addr, const mem_bits_t& value);
+#endif
+
 #ifdef ENABLE_SNAPSHOT
   private:
     // sample information
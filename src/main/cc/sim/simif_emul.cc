@@ -9,6 +9,9 @@
 #if VM_TRACE
 #include <verilated_vcd_c.h>
 #endif
+#include "spsc_ring.h"
+#include "mm_profile.h"
+#include <pthread.h>
 #endif
 #include <signal.h>
 
@@ -30,6 +33,174 @@ double sc_time_stamp() {
   return (double) main_time;
 }
 extern void tick();
+
+// With +emul-thread, the Verilated model and its bus models run freely on a
+// thread of their own, so the RTL evaluates while the host does its work.
+// The host reaches the bus models through mmio_proxy_t's, which pass
+// requests and responses over a pair of lock-free rings.
+#define EMUL_RING_SIZE 4096
+#define EMUL_CTRL 0
+#define EMUL_DMA 1
+
+struct emul_req_t {
+  uint32_t port;
+  uint32_t write;
+  uint64_t addr;
+  uint64_t size;
+  uint64_t len;
+  void* data;   // write data, valid until its response
+  size_t* strb; // copy of the write strobes, freed by the model thread
+};
+
+struct emul_resp_t {
+  uint32_t port;
+  uint32_t write;
+  size_t size;
+  char* data;   // malloc'd read data, freed by the host
+};
+
+// Zero-initialized static storage, as the rings expect
+static spsc_ring_t<emul_req_t, EMUL_RING_SIZE> emul_reqs;
+static spsc_ring_t<emul_resp_t, EMUL_RING_SIZE> emul_resps;
+static bool emul_threaded = false;
+static std::atomic<bool> emul_stop(false);
+static pthread_t emul_thread;
+
+static void* emul_main(void* arg) {
+  mmio_t* ports[] = { master.get(), dma.get() };
+  std::deque<size_t> reads[2]; // bytes of each read in flight
+  size_t writes[2] = { 0, 0 };
+  // Responses the host has no room for yet; the model never blocks on it
+  std::deque<emul_resp_t> resps;
+  emul_req_t reqs[64];
+
+  while (!emul_stop.load(std::memory_order_relaxed)) {
+    size_t n = emul_reqs.pop(reqs, 64);
+    for (size_t i = 0 ; i < n ; i++) {
+      emul_req_t& req = reqs[i];
+      if (req.write) {
+        ports[req.port]->write_req(req.addr, req.size, req.len, req.data, req.strb);
+        delete[] req.strb;
+        writes[req.port]++;
+      } else {
+        ports[req.port]->read_req(req.addr, req.size, req.len);
+        reads[req.port].push_back((req.len + 1) << req.size);
+      }
+    }
+
+    ::tick();
+
+    for (uint32_t p = 0 ; p < 2 ; p++) {
+      while (!reads[p].empty()) {
+        char* data = (char*)malloc(reads[p].front());
+        if (!ports[p]->read_resp(data)) {
+          free(data);
+          break;
+        }
+        resps.push_back(emul_resp_t { p, 0, reads[p].front(), data });
+        reads[p].pop_front();
+      }
+      while (writes[p] && ports[p]->write_resp()) {
+        resps.push_back(emul_resp_t { p, 1, 0, NULL });
+        writes[p]--;
+      }
+    }
+    while (!resps.empty() && emul_resps.push(&resps.front(), 1)) {
+      resps.pop_front();
+    }
+  }
+  return NULL;
+}
+
+class mmio_proxy_t: public mmio_t
+{
+public:
+  mmio_proxy_t(uint32_t port): port(port), acks(0) { }
+
+  virtual void read_req(uint64_t addr, size_t size, size_t len) {
+    send(emul_req_t { port, 0, addr, size, len, NULL, NULL });
+  }
+  virtual void write_req(uint64_t addr, size_t size, size_t len, void* data, size_t *strb) {
+    size_t* strb_copy = new size_t[len + 1];
+    std::copy(strb, strb + len + 1, strb_copy);
+    send(emul_req_t { port, 1, addr, size, len, data, strb_copy });
+  }
+  virtual bool read_resp(void *data) {
+    receive();
+    if (reads.empty()) return false;
+    memcpy(data, reads.front().data, reads.front().size);
+    free(reads.front().data);
+    reads.pop_front();
+    return true;
+  }
+  virtual bool write_resp() {
+    receive();
+    if (!acks) return false;
+    acks--;
+    return true;
+  }
+
+  // Blocks until the model thread answers anything
+  static void wait() {
+    emul_resps.wait([] { return !emul_resps.empty(); });
+  }
+
+  static mmio_proxy_t* proxies[2];
+
+private:
+  const uint32_t port;
+  std::deque<emul_resp_t> reads;
+  size_t acks;
+
+  static void send(const emul_req_t& req) {
+    while (!emul_reqs.push(&req, 1)) {
+      emul_reqs.wait([] { return !emul_reqs.full(); });
+    }
+  }
+
+  // Hands out every waiting response to the proxy of its port
+  static void receive() {
+    emul_resp_t resps[64];
+    size_t n;
+    while ((n = emul_resps.pop(resps, 64))) {
+      for (size_t i = 0 ; i < n ; i++) {
+        mmio_proxy_t* proxy = proxies[resps[i].port];
+        if (resps[i].write) {
+          proxy->acks++;
+        } else {
+          proxy->reads.push_back(resps[i]);
+        }
+      }
+    }
+  }
+};
+
+static mmio_proxy_t ctrl_proxy(EMUL_CTRL);
+static mmio_proxy_t dma_proxy(EMUL_DMA);
+mmio_proxy_t* mmio_proxy_t::proxies[2] = { &ctrl_proxy, &dma_proxy };
+
+static void emul_thread_start(int cpu) {
+  emul_threaded = true;
+  if (pthread_create(&emul_thread, NULL, emul_main, NULL)) {
+    fprintf(stderr, "Cannot start the emulation thread\n");
+    abort();
+  }
+  if (cpu >= 0) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+    if (pthread_setaffinity_np(emul_thread, sizeof(cpus), &cpus)) {
+      fprintf(stderr, "Cannot pin the emulation thread to cpu %d\n", cpu);
+    }
+  }
+}
+
+static void emul_thread_stop() {
+  if (!emul_threaded) return;
+  emul_stop = true;
+  pthread_join(emul_thread, NULL);
+  emul_threaded = false;
+}
 #endif // VCS
 
 void finish() {
@@ -37,6 +208,7 @@ void finish() {
   vcs_fin = true;
   target.switch_to();
 #else
+  emul_thread_stop();
 #if VM_TRACE
   if (tfp) tfp->close();
   delete tfp;
@@ -56,8 +228,12 @@ void simif_emul_t::init(int argc, char** argv, bool log) {
   std::string vcdfile = "dump.vcd";
   std::string loadmem;
   bool fastloadmem = false;
-  bool dramsim = false;
+  mm_model_t model = MM_MODEL_MAGIC;
   uint64_t memsize = 1L << 32;
+  bool threaded = false;
+  int emul_cpu = -1;
+  mm_pages_t pages = MM_PAGES_DEFAULT;
+  std::string image, save_image;
   for (auto arg: args) {
     if (arg.find("+vcdfile=") == 0) {
       vcdfile = arg.c_str() + 10;
@@ -68,19 +244,33 @@ void simif_emul_t::init(int argc, char** argv, bool log) {
     if (arg.find("+fastloadmem") == 0) {
       fastloadmem = true;
     }
-    if (arg.find("+dramsim") == 0) {
-      dramsim = true;
-    }
+    mm_parse_model(arg, &model);
     if (arg.find("+memsize=") == 0) {
       memsize = strtoll(arg.c_str() + 9, NULL, 10);
     }
+    if (arg.find("+mem-stats") == 0) {
+      mem_stats = true;
+    }
+    mm_parse_pages(arg, &pages);
+    mm_parse_image(arg, &image, &save_image);
+    if (arg.find("+emul-thread") == 0) {
+      threaded = true;
+      if (arg.find("+emul-thread=") == 0) {
+        emul_cpu = strtol(arg.c_str() + 13, NULL, 10);
+      }
+    }
   }
 
+  mem = ::init(memsize, model, pages, image);
+  mem->parse_args(args);
+  mm_profile_init(mem, args);
   void* mems[1];
-  mems[0] = ::init(memsize, dramsim);
-  if (mems[0] && fastloadmem && !loadmem.empty()) {
+  mems[0] = mem->get_data();
+  if (!image.empty()) {
+    fprintf(stdout, "[mem image] %s\n", image.c_str());
+  } else if (mems[0] && fastloadmem && !loadmem.empty()) {
     fprintf(stdout, "[fast loadmem] %s\n", loadmem.c_str());
-    ::load_mem(mems, loadmem.c_str(), MEM_DATA_BITS / 8, 1);
+    ::load_mem(mems, loadmem.c_str(), MEM_DATA_BITS / 8, 1, mem->get_size());
   }
 
   signal(SIGTERM, handle_sigterm);
@@ -109,91 +299,193 @@ void simif_emul_t::init(int argc, char** argv, bool log) {
   top->reset = 0;
 #endif
 
+  ctrl_port = master.get();
+  dma_port = dma.get();
+#ifndef VCS
+  if (threaded) {
+    emul_thread_start(emul_cpu);
+    ctrl_port = mmio_proxy_t::proxies[EMUL_CTRL];
+    dma_port = mmio_proxy_t::proxies[EMUL_DMA];
+  }
+#endif
+
   simif_t::init(argc, argv, log);
+  // After simif_t::init, so images loaded through LOADMEM are included
+  if (!save_image.empty() && mem->save_image(save_image)) {
+    fprintf(stdout, "[mem image] saved %s\n", save_image.c_str());
+  }
 }
 
 int simif_emul_t::finish() {
   int exitcode = simif_t::finish();
   ::finish();
+  mem->close_profile();
+  if (mem_stats) mem->print_stats(stderr);
   return exitcode;
 }
 
-void simif_emul_t::wait_write(std::unique_ptr<mmio_t>& mmio) {
+void simif_emul_t::wait_write(mmio_t* mmio) {
   while(!mmio->write_resp()) {
 #ifdef VCS
     target.switch_to();
 #else
-    ::tick();
+    if (emul_threaded) {
+      mmio_proxy_t::wait();
+    } else {
+      ::tick();
+    }
 #endif
   }
 }
 
-void simif_emul_t::wait_read(std::unique_ptr<mmio_t>& mmio, void *data) {
+void simif_emul_t::wait_read(mmio_t* mmio, void *data) {
   while(!mmio->read_resp(data)) {
 #ifdef VCS
     target.switch_to();
 #else
-    ::tick();
+    if (emul_threaded) {
+      mmio_proxy_t::wait();
+    } else {
+      ::tick();
+    }
 #endif
   }
 }
 
 void simif_emul_t::write(size_t addr, data_t data) {
+  MMIO_PROFILE_OP(MMIO_WRITE, 1, sizeof(data_t));
   size_t strb = (1 << CTRL_STRB_BITS) - 1;
-  master->write_req(addr << CHANNEL_SIZE, CHANNEL_SIZE, 0, &data, &strb);
-  wait_write(master);
+  ctrl_port->write_req(addr << CHANNEL_SIZE, CHANNEL_SIZE, 0, &data, &strb);
+  wait_write(ctrl_port);
 }
 
 data_t simif_emul_t::read(size_t addr) {
+  MMIO_PROFILE_OP(MMIO_READ, 1, sizeof(data_t));
   data_t data;
-  master->read_req(addr << CHANNEL_SIZE, CHANNEL_SIZE, 0);
-  wait_read(master, &data);
+  ctrl_port->read_req(addr << CHANNEL_SIZE, CHANNEL_SIZE, 0);
+  wait_read(ctrl_port, &data);
   return data;
 }
 
+void simif_emul_t::read_req(size_t addr) {
+  ctrl_port->read_req(addr << CHANNEL_SIZE, CHANNEL_SIZE, 0);
+}
+
+bool simif_emul_t::read_resp(data_t* data) {
+  if (ctrl_port->read_resp(data)) return true;
+#ifdef VCS
+  target.switch_to();
+#else
+  if (!emul_threaded) ::tick();
+#endif
+  return false;
+}
+
+void simif_emul_t::flush() {
+  MMIO_PROFILE_OP(MMIO_FLUSH, batch.size(), batch.size() * sizeof(data_t));
+  size_t strb = (1 << CTRL_STRB_BITS) - 1;
+  auto op = batch.begin();
+  while (op != batch.end()) {
+    // Requests of the same kind are queued back to back. Reads and writes
+    // travel on independent channels, so wait for one run to finish
+    // before issuing the next to keep the accesses in order.
+    const bool is_read = op->dst != NULL;
+    auto end = op;
+    for (; end != batch.end() && (end->dst != NULL) == is_read ; end++) {
+      if (is_read) {
+        ctrl_port->read_req(end->addr << CHANNEL_SIZE, CHANNEL_SIZE, 0);
+      } else {
+        ctrl_port->write_req(end->addr << CHANNEL_SIZE, CHANNEL_SIZE, 0, &end->data, &strb);
+      }
+    }
+    for (; op != end ; op++) {
+      if (is_read) {
+        wait_read(ctrl_port, op->dst);
+      } else {
+        wait_write(ctrl_port);
+      }
+    }
+  }
+  batch.clear();
+}
+
 #define MAX_LEN 255
 
 ssize_t simif_emul_t::pull(size_t addr, char* data, size_t size) {
+  MMIO_PROFILE_OP(MMIO_PULL, 1, size);
+  return dma_wait(pull_async(addr, data, size));
+}
+
+ssize_t simif_emul_t::push(size_t addr, char *data, size_t size) {
+  MMIO_PROFILE_OP(MMIO_PUSH, 1, size);
+  return dma_wait(push_async(addr, data, size));
+}
+
+// Bursts of every transfer are queued up front and the dma port
+// works through them while the host keeps going
+int simif_emul_t::pull_async(size_t addr, char* data, size_t size) {
+  dma_xfer_t xfer = { dma_tag++, true, size };
   ssize_t len = (size - 1) / DMA_WIDTH;
 
   while (len >= 0) {
       size_t part_len = len % (MAX_LEN + 1);
 
-      dma->read_req(addr, DMA_SIZE, part_len);
-      wait_read(dma, data);
+      dma_port->read_req(addr, DMA_SIZE, part_len);
+      xfer.bursts.push_back(data);
 
       len -= (part_len + 1);
       addr += (part_len + 1) * DMA_WIDTH;
       data += (part_len + 1) * DMA_WIDTH;
   }
-  return size;
+  dma_inflight.push_back(xfer);
+  return xfer.tag;
 }
 
-ssize_t simif_emul_t::push(size_t addr, char *data, size_t size) {
+int simif_emul_t::push_async(size_t addr, char *data, size_t size) {
+  dma_xfer_t xfer = { dma_tag++, false, size };
   ssize_t len = (size - 1) / DMA_WIDTH;
   size_t remaining = size - len * DMA_WIDTH;
   size_t strb[len + 1];
   size_t *strb_ptr = &strb[0];
+  const size_t full_strb = DMA_WIDTH >= 64 ? ~0ULL : (1ULL << DMA_WIDTH) - 1;
 
   for (int i = 0; i < len; i++)
-      strb[i] = (1LL << DMA_WIDTH) - 1;
+      strb[i] = full_strb;
 
   if (remaining == DMA_WIDTH)
-      strb[len] = strb[0];
+      strb[len] = full_strb;
   else
-      strb[len] = (1LL << remaining) - 1;
+      strb[len] = (1ULL << remaining) - 1;
 
   while (len >= 0) {
       size_t part_len = len % (MAX_LEN + 1);
 
-      dma->write_req(addr, DMA_SIZE, part_len, data, strb_ptr);
-      wait_write(dma);
+      // strobes are copied, data is read from the buffer as beats go out
+      dma_port->write_req(addr, DMA_SIZE, part_len, data, strb_ptr);
+      xfer.bursts.push_back(NULL);
 
       len -= (part_len + 1);
       addr += (part_len + 1) * DMA_WIDTH;
       data += (part_len + 1) * DMA_WIDTH;
       strb_ptr += (part_len + 1);
   }
+  dma_inflight.push_back(xfer);
+  return xfer.tag;
+}
 
-  return size;
+ssize_t simif_emul_t::dma_wait(int tag) {
+  // The dma port answers in order, so retire everything issued before tag
+  while (!dma_inflight.empty() && dma_inflight.front().tag <= tag) {
+    dma_xfer_t& xfer = dma_inflight.front();
+    for (auto burst: xfer.bursts) {
+      if (xfer.read) {
+        wait_read(dma_port, burst);
+      } else {
+        wait_write(dma_port);
+      }
+    }
+    dma_done[xfer.tag] = xfer.size;
+    dma_inflight.pop_front();
+  }
+  return simif_t::dma_wait(tag);
 }
@@ -4,6 +4,7 @@
 #define __SIMIF_VERILATOR_H
 
 #include <memory>
+#include <deque>
 
 #include "simif.h"
 #include "mm.h"
@@ -13,19 +14,46 @@
 class simif_emul_t : public virtual simif_t
 {
   public:
-    simif_emul_t() { }
+    simif_emul_t(): ctrl_port(NULL), dma_port(NULL), mem(NULL), mem_stats(false) { }
     virtual ~simif_emul_t();
     virtual void init(int argc, char** argv, bool log = false);
     virtual int finish();
 
     virtual void write(size_t addr, data_t data);
     virtual data_t read(size_t addr);
+    virtual void flush();
+
+    // Non-blocking control reads. read_req issues a read and read_resp
+    // collects the oldest one, advancing the model and returning false while
+    // it is still in flight. Up to MMIO_MAX_READS reads overlap on the bus.
+    void read_req(size_t addr);
+    bool read_resp(data_t* data);
     virtual ssize_t pull(size_t addr, char* data, size_t size);
     virtual ssize_t push(size_t addr, char* data, size_t size);
+    virtual bool has_dma() { return dma_port != NULL; }
+    virtual int pull_async(size_t addr, char* data, size_t size);
+    virtual int push_async(size_t addr, char* data, size_t size);
+    virtual ssize_t dma_wait(int tag);
 
   private:
-    void wait_read(std::unique_ptr<mmio_t>& mmio, void *data);
-    void wait_write(std::unique_ptr<mmio_t>& mmio);
+    // Where the host sends its accesses: the bus models themselves, or
+    // proxies to them when the model runs on its own thread (+emul-thread)
+    mmio_t* ctrl_port;
+    mmio_t* dma_port;
+    // The target memory; +mem-stats reports how much of it was touched
+    mm_t* mem;
+    bool mem_stats;
+
+    // A bulk transfer split into bursts queued on the dma port
+    struct dma_xfer_t {
+      int tag;
+      bool read;
+      size_t size;
+      std::vector<char*> bursts; // destination of each read burst
+    };
+    std::deque<dma_xfer_t> dma_inflight;
+    void wait_read(mmio_t* mmio, void *data);
+    void wait_write(mmio_t* mmio);
 };
 
 #endif // __SIMIF_VERILATOR_H
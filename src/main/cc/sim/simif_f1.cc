@@ -1,13 +1,20 @@
 #include "simif_f1.h"
 #include <cassert>
+#include <algorithm>
 
+#include <cstring>
+#include <errno.h>
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
 simif_f1_t::simif_f1_t() {
-#ifdef SIMULATION_XSIM
+#if defined(SIMULATION_XSIM) && defined(XSIM_SHM)
+    fprintf(stderr, "mapping %s, start xsim now\n", xsim_shm_file);
+    shm = xsim_shm_map(xsim_shm_file, true);
+    assert(shm);
+#elif defined(SIMULATION_XSIM)
     mkfifo(driver_to_xsim, 0666);
     fprintf(stderr, "opening driver to xsim\n");
     driver_to_xsim_fd = open(driver_to_xsim, O_WRONLY);
@@ -38,12 +45,20 @@ void simif_f1_t::fpga_shutdown() {
     if (rc) {
         fprintf(stderr, "Failure while detaching from the fpga: %d\n", rc);
     }
-    // FIXME: close(edma_fd);
+    if (edma_fd >= 0) {
+        for (size_t i = 0 ; i < EDMA_MAX_INFLIGHT ; i++) {
+            if (edma_tags[i] >= 0) edma_complete(i);
+        }
+        close(edma_fd);
+    }
 #endif
 }
 
 void simif_f1_t::fpga_setup() {
 #ifndef SIMULATION_XSIM
+    edma_fd = -1;
+    std::fill(edma_tags, edma_tags + EDMA_MAX_INFLIGHT, -1);
+
     /*
      * pci_vendor_id and pci_device_id values below are Amazon's and avaliable
      * to use for a given FPGA slot.
@@ -103,29 +118,48 @@ void simif_f1_t::fpga_setup() {
     rc = fpga_pci_attach(0, FPGA_APP_PF, APP_PF_BAR0, 0, &pci_bar_handle);
     check_rc(rc, (char*)"fpga_pci_attach FAILED");
 
+    // Batched accesses bypass fpga_pci_poke/peek if BAR0 can be mapped.
+    // The SDK takes the length of the range in dwords.
+    void* bar0 = NULL;
+    rc = fpga_pci_get_address(pci_bar_handle, 0,
+                              (1ULL << CTRL_ADDR_BITS) / sizeof(uint32_t), &bar0);
+    bar0_vaddr = rc ? NULL : (volatile uint32_t*)bar0;
+    if (!bar0_vaddr) {
+        fprintf(stderr, "Cannot map BAR0, batched accesses use fpga_pci_peek/poke\n");
+    }
+
     // EDMA setup
     char device_file_name[256];
     
     sprintf(device_file_name, "/dev/edma%d_queue_0", slot_id);
     printf("Using edma queue: %s\n", device_file_name);
 
-    /* FIXME
     edma_fd = open(device_file_name, O_RDWR);
-    assert(edma_fd >= 0);
-    */
+    if (edma_fd < 0) {
+        fprintf(stderr, "Cannot open %s, bulk transfers are disabled\n", device_file_name);
+    }
 #endif
 }
 
 
 
 simif_f1_t::~simif_f1_t() {
+#if defined(SIMULATION_XSIM) && defined(XSIM_SHM)
+    xsim_msg_t msg = { XSIM_EXIT, 0, 0, 0 };
+    xsim_send(&msg, 1);
+    munmap(shm, sizeof(xsim_shm_t));
+#endif
     fpga_shutdown();
 }
 
 void simif_f1_t::write(size_t addr, uint32_t data) {
+    MMIO_PROFILE_OP(MMIO_WRITE, 1, sizeof(uint32_t));
     // addr is really a (32-byte) word address because of zynq implementation
     addr <<= 2;
-#ifdef SIMULATION_XSIM
+#if defined(SIMULATION_XSIM) && defined(XSIM_SHM)
+    xsim_msg_t msg = { XSIM_WRITE, data, addr, 0 };
+    xsim_send(&msg, 1);
+#elif defined(SIMULATION_XSIM)
     uint64_t cmd = (((uint64_t)(0x80000000 | addr)) << 32) | (uint64_t)data;
     char * buf = (char*)&cmd;
     ::write(driver_to_xsim_fd, buf, 8);
@@ -136,12 +170,47 @@ void simif_f1_t::write(size_t addr, uint32_t data) {
 }
 
 uint32_t simif_f1_t::read(size_t addr) {
+    MMIO_PROFILE_OP(MMIO_READ, 1, sizeof(uint32_t));
     addr <<= 2;
-#ifdef SIMULATION_XSIM
+#if defined(SIMULATION_XSIM) && defined(XSIM_SHM)
+    xsim_msg_t msg = { XSIM_READ, 0, addr, 0 };
+    xsim_send(&msg, 1);
+    xsim_recv(&msg, 1);
+    return msg.data;
+#elif defined(SIMULATION_XSIM)
     uint64_t cmd = addr;
     char * buf = (char*)&cmd;
     ::write(driver_to_xsim_fd, buf, 8);
+    return xsim_resp();
+#else
+    uint32_t value;
+    int rc = fpga_pci_peek(pci_bar_handle, addr, &value);
+    return value & 0xFFFFFFFF;
+#endif
+}
 
+#if defined(SIMULATION_XSIM) && defined(XSIM_SHM)
+void simif_f1_t::xsim_send(const xsim_msg_t* msgs, size_t n) {
+    while (n) {
+        size_t sent = shm->req.push(msgs, n);
+        msgs += sent;
+        n -= sent;
+        if (n) shm->req.wait([this] { return !shm->req.full(); });
+    }
+}
+
+void simif_f1_t::xsim_recv(xsim_msg_t* msgs, size_t n) {
+    while (n) {
+        shm->resp.wait([this] { return !shm->resp.empty(); });
+        size_t got = shm->resp.pop(msgs, n);
+        msgs += got;
+        n -= got;
+    }
+}
+#elif defined(SIMULATION_XSIM)
+uint64_t simif_f1_t::xsim_resp() {
+    uint64_t resp;
+    char * buf = (char*)&resp;
     int gotdata = 0;
     while (gotdata == 0) {
         gotdata = ::read(xsim_to_driver_fd, buf, 8);
@@ -149,33 +218,199 @@ uint32_t simif_f1_t::read(size_t addr) {
             printf("ERR GOTDATA %d\n", gotdata);
         }
     }
-    return *((uint64_t*)buf);
+    return resp;
+}
+
+// Bounds the commands in flight so that xsim never blocks on a full pipe
+#define XSIM_BATCH_SIZE 1024
+#endif
+
+void simif_f1_t::flush() {
+#if defined(SIMULATION_XSIM) && defined(XSIM_SHM)
+    MMIO_PROFILE_OP(MMIO_FLUSH, batch.size(), batch.size() * sizeof(uint32_t));
+    // Publish a ring's worth of requests at once, then drain the responses
+    // so that the simulator never blocks on a full response ring
+    xsim_msg_t msgs[XSIM_RING_SIZE];
+    for (size_t base = 0 ; base < batch.size() ; base += XSIM_RING_SIZE) {
+        size_t end = std::min(batch.size(), (size_t)(base + XSIM_RING_SIZE));
+        size_t reads = 0;
+        for (size_t i = base ; i < end ; i++) {
+            msgs[i - base] = batch[i].dst ?
+                xsim_msg_t { XSIM_READ, 0, batch[i].addr << 2, 0 } :
+                xsim_msg_t { XSIM_WRITE, batch[i].data, batch[i].addr << 2, 0 };
+            if (batch[i].dst) reads++;
+        }
+        xsim_send(msgs, end - base);
+        xsim_recv(msgs, reads);
+        size_t r = 0;
+        for (size_t i = base ; i < end ; i++) {
+            if (batch[i].dst) *batch[i].dst = msgs[r++].data;
+        }
+    }
+    batch.clear();
+#elif defined(SIMULATION_XSIM)
+    MMIO_PROFILE_OP(MMIO_FLUSH, batch.size(), batch.size() * sizeof(uint32_t));
+    // Send a chunk of commands with a single write,
+    // then collect the read responses in order
+    uint64_t cmds[XSIM_BATCH_SIZE];
+    for (size_t base = 0 ; base < batch.size() ; base += XSIM_BATCH_SIZE) {
+        size_t end = std::min(batch.size(), (size_t)(base + XSIM_BATCH_SIZE));
+        for (size_t i = base ; i < end ; i++) {
+            uint64_t addr = batch[i].addr << 2;
+            cmds[i - base] = batch[i].dst ? addr :
+                (((uint64_t)(0x80000000 | addr)) << 32) | (uint64_t)batch[i].data;
+        }
+        ::write(driver_to_xsim_fd, (char*)cmds, (end - base) * sizeof(uint64_t));
+        for (size_t i = base ; i < end ; i++) {
+            if (batch[i].dst) *batch[i].dst = xsim_resp();
+        }
+    }
+    batch.clear();
 #else
-    uint32_t value;
-    int rc = fpga_pci_peek(pci_bar_handle, addr, &value);
-    return value & 0xFFFFFFFF;
+    if (!bar0_vaddr) {
+        simif_t::flush();
+        return;
+    }
+    MMIO_PROFILE_OP(MMIO_FLUSH, batch.size(), batch.size() * sizeof(uint32_t));
+    // addr is a word address, so it indexes BAR0 directly
+    for (auto& op: batch) {
+        if (op.dst) {
+            *op.dst = bar0_vaddr[op.addr];
+        } else {
+            bar0_vaddr[op.addr] = op.data;
+        }
+    }
+    batch.clear();
 #endif
 }
 
 ssize_t simif_f1_t::pull(size_t addr, char* data, size_t size) {
-#ifdef SIMULATION_XSIM
-  return -1; // TODO
+  MMIO_PROFILE_OP(MMIO_PULL, 1, size);
+#if defined(SIMULATION_XSIM) && defined(XSIM_SHM)
+  // Staged through the shared dma area a chunk at a time
+  for (size_t off = 0 ; off < size ; off += XSIM_DMA_SIZE) {
+    size_t len = std::min(size - off, (size_t)XSIM_DMA_SIZE);
+    xsim_msg_t msg = { XSIM_PULL, 0, addr + off, len };
+    xsim_send(&msg, 1);
+    xsim_recv(&msg, 1);
+    if (msg.data) return -1;
+    memcpy(data + off, shm->dma, len);
+  }
+  return size;
+#elif defined(SIMULATION_XSIM)
+  return -1; // TODO: no DMA channel to xsim
 #else
-  return ::pread(edma_fd, data, size, addr);
+  // The driver may split a transfer, so keep going until it is done
+  size_t done = 0;
+  while (done < size) {
+    ssize_t n = ::pread(edma_fd, data + done, size - done, addr + done);
+    if (n <= 0) return -1;
+    done += n;
+  }
+  return done;
 #endif
 }
 
 ssize_t simif_f1_t::push(size_t addr, char* data, size_t size) {
-#ifdef SIMULATION_XSIM
-  return -1; // TODO
+  MMIO_PROFILE_OP(MMIO_PUSH, 1, size);
+#if defined(SIMULATION_XSIM) && defined(XSIM_SHM)
+  for (size_t off = 0 ; off < size ; off += XSIM_DMA_SIZE) {
+    size_t len = std::min(size - off, (size_t)XSIM_DMA_SIZE);
+    memcpy(shm->dma, data + off, len);
+    xsim_msg_t msg = { XSIM_PUSH, 0, addr + off, len };
+    xsim_send(&msg, 1);
+    xsim_recv(&msg, 1);
+    if (msg.data) return -1;
+  }
+  return size;
+#elif defined(SIMULATION_XSIM)
+  return -1; // TODO: no DMA channel to xsim
+#else
+  size_t done = 0;
+  while (done < size) {
+    ssize_t n = ::pwrite(edma_fd, data + done, size - done, addr + done);
+    if (n <= 0) return -1;
+    done += n;
+  }
+  return done;
+#endif
+}
+
+bool simif_f1_t::has_dma() {
+#if defined(SIMULATION_XSIM) && defined(XSIM_SHM)
+  return true;
+#elif defined(SIMULATION_XSIM)
+  return false;
 #else
-  return ::pwrite(edma_fd, data, size, addr);
+  return edma_fd >= 0;
 #endif
 }
 
+#ifndef SIMULATION_XSIM
+// Hands a transfer to the EDMA driver through POSIX AIO.
+// When every slot is taken the oldest transfer is retired first.
+int simif_f1_t::edma_submit(int opcode, size_t addr, char* data, size_t size) {
+  size_t slot = 0;
+  for (size_t i = 0 ; i < EDMA_MAX_INFLIGHT ; i++) {
+    if (edma_tags[i] < 0) {
+      slot = i;
+      break;
+    }
+    if (edma_tags[i] < edma_tags[slot]) slot = i;
+  }
+  if (edma_tags[slot] >= 0) edma_complete(slot);
+
+  int tag = dma_tag++;
+  struct aiocb* cb = &edma_cbs[slot];
+  memset(cb, 0, sizeof(struct aiocb));
+  cb->aio_fildes = edma_fd;
+  cb->aio_buf = data;
+  cb->aio_nbytes = size;
+  cb->aio_offset = addr;
+  int rc = opcode == LIO_READ ? aio_read(cb) : aio_write(cb);
+  if (rc) {
+    dma_done[tag] = -1;
+  } else {
+    edma_tags[slot] = tag;
+  }
+  return tag;
+}
+
+void simif_f1_t::edma_complete(size_t slot) {
+  struct aiocb* cb = &edma_cbs[slot];
+  while (aio_error(cb) == EINPROGRESS) {
+    aio_suspend(&cb, 1, NULL);
+  }
+  dma_done[edma_tags[slot]] = aio_return(cb);
+  edma_tags[slot] = -1;
+}
+
+int simif_f1_t::pull_async(size_t addr, char* data, size_t size) {
+  if (edma_fd < 0) return simif_t::pull_async(addr, data, size);
+  return edma_submit(LIO_READ, addr, data, size);
+}
+
+int simif_f1_t::push_async(size_t addr, char* data, size_t size) {
+  if (edma_fd < 0) return simif_t::push_async(addr, data, size);
+  return edma_submit(LIO_WRITE, addr, data, size);
+}
+
+ssize_t simif_f1_t::dma_wait(int tag) {
+  for (size_t i = 0 ; i < EDMA_MAX_INFLIGHT ; i++) {
+    if (edma_tags[i] == tag) edma_complete(i);
+  }
+  return simif_t::dma_wait(tag);
+}
+#endif
+
 uint32_t simif_f1_t::is_write_ready() {
     uint64_t addr = 0x4;
-#ifdef SIMULATION_XSIM
+#if defined(SIMULATION_XSIM) && defined(XSIM_SHM)
+    xsim_msg_t msg = { XSIM_READ, 0, addr, 0 };
+    xsim_send(&msg, 1);
+    xsim_recv(&msg, 1);
+    return msg.data;
+#elif defined(SIMULATION_XSIM)
     uint64_t cmd = addr;
     char * buf = (char*)&cmd;
     ::write(driver_to_xsim_fd, buf, 8);
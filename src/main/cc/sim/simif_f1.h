@@ -3,9 +3,16 @@
 
 #include "simif.h"    // from midas
 
+#if defined(SIMULATION_XSIM) && defined(XSIM_SHM)
+#include "xsim_shm.h"
+#endif
 #ifndef SIMULATION_XSIM
 #include <fpga_pci.h>
 #include <fpga_mgmt.h>
+#include <aio.h>
+
+// Bounds the EDMA transfers queued on the driver at once
+#define EDMA_MAX_INFLIGHT 8
 #endif
 
 class simif_f1_t: public virtual simif_t
@@ -15,8 +22,15 @@ class simif_f1_t: public virtual simif_t
     virtual ~simif_f1_t();
     virtual void write(size_t addr, uint32_t data);
     virtual uint32_t read(size_t addr);
+    virtual void flush();
     virtual ssize_t pull(size_t addr, char* data, size_t size);
     virtual ssize_t push(size_t addr, char* data, size_t size);
+    virtual bool has_dma();
+#ifndef SIMULATION_XSIM
+    virtual int pull_async(size_t addr, char* data, size_t size);
+    virtual int push_async(size_t addr, char* data, size_t size);
+    virtual ssize_t dma_wait(int tag);
+#endif
     uint32_t is_write_ready();
     void check_rc(int rc, char * infostr);
     void fpga_shutdown();
@@ -24,16 +38,29 @@ class simif_f1_t: public virtual simif_t
   private:
     char in_buf[MMIO_WIDTH];
     char out_buf[MMIO_WIDTH];
-#ifdef SIMULATION_XSIM
+#if defined(SIMULATION_XSIM) && defined(XSIM_SHM)
+    const char * xsim_shm_file = "/tmp/xsim_shm";
+    xsim_shm_t* shm;
+    void xsim_send(const xsim_msg_t* msgs, size_t n);
+    void xsim_recv(xsim_msg_t* msgs, size_t n);
+#elif defined(SIMULATION_XSIM)
     char * driver_to_xsim = "/tmp/driver_to_xsim";
     char * xsim_to_driver = "/tmp/xsim_to_driver";
     int driver_to_xsim_fd;
     int xsim_to_driver_fd;
+    uint64_t xsim_resp();
 #else
 //    int rc;
     int slot_id;
     int edma_fd;
+    // EDMA transfers in flight, a free slot has a negative tag
+    struct aiocb edma_cbs[EDMA_MAX_INFLIGHT];
+    int edma_tags[EDMA_MAX_INFLIGHT];
+    int edma_submit(int opcode, size_t addr, char* data, size_t size);
+    void edma_complete(size_t slot);
     pci_bar_handle_t pci_bar_handle;
+    // BAR0 mapped into our address space for batched accesses
+    volatile uint32_t* bar0_vaddr;
 #endif
 };
 
@@ -0,0 +1,280 @@
+// See LICENSE for license details.
+
+#include "simif_mock.h"
+#include <algorithm>
+#include <time.h>
+
+static inline uint64_t mock_now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return 1000000000ULL * ts.tv_sec + ts.tv_nsec;
+}
+
+// Burns ns nanoseconds, as a blocking PCIe access would
+static inline void mock_wait(uint64_t ns) {
+  if (!ns) return;
+  const uint64_t end = mock_now() + ns;
+  while (mock_now() < end);
+}
+
+simif_mock_t::simif_mock_t():
+  cycle(0), target_end(0), counter_reads(0), mock_gen(0),
+  read_latency(0), write_latency(0), dma_latency(0)
+{
+  std::fill(period, period + NUM_EVENTS, 0);
+  std::fill(next_event, next_event + NUM_EVENTS, 0);
+  std::fill(pending, pending + NUM_EVENTS, false);
+  std::fill(num_events, num_events + NUM_EVENTS, 0);
+}
+
+void simif_mock_t::init(int argc, char** argv, bool log) {
+  init_model(argc, argv);
+  simif_t::init(argc, argv, log);
+}
+
+void simif_mock_t::init_model(int argc, char** argv) {
+  std::vector<std::string> args(argv + 1, argv + argc);
+  for (auto &arg: args) {
+    if (arg.find("+mock-latency=") == 0) {
+      read_latency = strtoll(arg.c_str() + 14, NULL, 10);
+    }
+    if (arg.find("+mock-write-latency=") == 0) {
+      write_latency = strtoll(arg.c_str() + 20, NULL, 10);
+    }
+    if (arg.find("+mock-dma-latency=") == 0) {
+      dma_latency = strtoll(arg.c_str() + 18, NULL, 10);
+    }
+    if (arg.find("+mock-serial-period=") == 0) {
+      set_period(SERIAL_EVENT, strtoll(arg.c_str() + 20, NULL, 10));
+    }
+    if (arg.find("+mock-uart-period=") == 0) {
+      set_period(UART_EVENT, strtoll(arg.c_str() + 18, NULL, 10));
+    }
+    if (arg.find("+mock-mem-period=") == 0) {
+      set_period(MEM_EVENT, strtoll(arg.c_str() + 17, NULL, 10));
+    }
+  }
+
+  // The target side of every input queue always has room
+#ifdef SERIALWIDGET_0
+  set_reg(SERIALWIDGET_0(in_ready), 1);
+#endif
+#ifdef UARTWIDGET_0
+  set_reg(UARTWIDGET_0(in_ready), 1);
+#endif
+#ifdef NASTIWIDGET_0
+  // r and b ready
+  set_reg(NASTIWIDGET_0(valid), 0x3);
+#endif
+}
+
+void simif_mock_t::set_period(event_t e, uint64_t p) {
+  period[e] = p;
+  next_event[e] = cycle + p;
+}
+
+void simif_mock_t::raise(event_t e) {
+  pending[e] = true;
+  size_t n = num_events[e]++;
+  switch (e) {
+    case SERIAL_EVENT:
+#ifdef SERIALWIDGET_0
+      set_reg(SERIALWIDGET_0(out_bits), mock_gen());
+      set_reg(SERIALWIDGET_0(out_valid), 1);
+#endif
+      break;
+    case UART_EVENT: {
+#ifdef UARTWIDGET_0
+      static const char text[] = "mock uart output\n";
+      set_reg(UARTWIDGET_0(out_bits), text[n % (sizeof(text) - 1)]);
+      set_reg(UARTWIDGET_0(out_valid), 1);
+#endif
+      break;
+    }
+    case MEM_EVENT: {
+#ifdef NASTIWIDGET_0
+      // Single-beat requests, alternating reads and writes
+      const size_t beat_bytes = MEM_DATA_BITS / 8;
+      const data_t size = __builtin_ctzll(beat_bytes);
+      const data_t meta = (size << MEM_LEN_BITS);
+      const uint64_t addr = (mock_gen() % (1 << 20)) * beat_bytes;
+      data_t valid = reg(NASTIWIDGET_0(valid));
+      if (n % 2 == 0) {
+#ifdef NASTIWIDGET_0_ar_bits
+        set_reg(NASTIWIDGET_0(ar_bits), meta);
+#else
+        set_reg(NASTIWIDGET_0(ar_meta), meta);
+        set_reg(NASTIWIDGET_0(ar_addr), addr);
+#endif
+        valid |= 0x1 << 4;
+      } else {
+#ifdef NASTIWIDGET_0_aw_bits
+        set_reg(NASTIWIDGET_0(aw_bits), meta);
+#else
+        set_reg(NASTIWIDGET_0(aw_meta), meta);
+        set_reg(NASTIWIDGET_0(aw_addr), addr);
+#endif
+        // strb and last
+        set_reg(NASTIWIDGET_0(w_meta), (((1ULL << beat_bytes) - 1) << 1) | 0x1);
+        valid |= (0x1 << 3) | (0x1 << 2);
+      }
+#ifdef NASTIWIDGET_0_DMA_ADDR
+      // The record of the beats, in the layout sim_mem.h decodes
+      const size_t words = DMA_WIDTH / sizeof(uint64_t);
+      const size_t base = mem_records.size();
+      mem_records.resize(base + words, 0);
+      uint64_t* rec = &mem_records[base];
+      rec[0] = n % 2 == 0 ? 0x1 << 4 : (0x1 << 3) | (0x1 << 2);
+      rec[1] = addr;
+      rec[2] = meta;
+      rec[3] = addr;
+      rec[4] = meta;
+      rec[5] = (((1ULL << beat_bytes) - 1) << 1) | 0x1;
+#endif
+      set_reg(NASTIWIDGET_0(valid), valid);
+#endif
+      break;
+    }
+    case COUNTER_EVENT:
+      counter_reads = 0;
+      break;
+    default:
+      break;
+  }
+}
+
+// Runs the target up to the end of the step or the next event
+void simif_mock_t::advance() {
+  for (size_t e = 0 ; e < NUM_EVENTS ; e++) {
+    if (pending[e]) return;
+  }
+  uint64_t next = target_end;
+  for (size_t e = 0 ; e < NUM_EVENTS ; e++) {
+    if (period[e]) next = std::min(next, next_event[e]);
+  }
+  cycle = std::max(cycle, next);
+  for (size_t e = 0 ; e < NUM_EVENTS ; e++) {
+    if (period[e] && next_event[e] <= cycle) {
+      raise((event_t)e);
+      next_event[e] += period[e];
+    }
+  }
+}
+
+data_t simif_mock_t::model_status() {
+  advance();
+  bool busy = false;
+  for (size_t e = 0 ; e < NUM_EVENTS ; e++) {
+    busy |= pending[e];
+  }
+  const data_t done = !busy && cycle >= target_end;
+  data_t status = done << MASTER(DONE_BIT);
+#define MOCK_STATUS(done_bit, pending_bit, e) \
+  status |= (done << (done_bit)) | ((data_t)pending[e] << (pending_bit));
+#ifdef ENABLE_COUNTERS
+  MOCK_STATUS(TOGGLECOUNTERWIDGET_DONE_BIT, TOGGLECOUNTERWIDGET_PENDING_BIT, COUNTER_EVENT)
+#endif
+#ifdef SERIALWIDGET_0
+  MOCK_STATUS(SERIALWIDGET_0(DONE_BIT), SERIALWIDGET_0(PENDING_BIT), SERIAL_EVENT)
+#endif
+#ifdef UARTWIDGET_0
+  MOCK_STATUS(UARTWIDGET_0(DONE_BIT), UARTWIDGET_0(PENDING_BIT), UART_EVENT)
+#endif
+#ifdef NASTIWIDGET_0
+  MOCK_STATUS(NASTIWIDGET_0(DONE_BIT), NASTIWIDGET_0(PENDING_BIT), MEM_EVENT)
+#endif
+#undef MOCK_STATUS
+  return status;
+}
+
+void simif_mock_t::write(size_t addr, data_t data) {
+  MMIO_PROFILE_OP(MMIO_WRITE, 1, sizeof(data_t));
+  mock_wait(write_latency);
+  set_reg(addr, data);
+  if (addr == MASTER(STEP)) {
+    target_end = cycle + data;
+  } else if (addr == MASTER(SIM_RESET)) {
+    std::fill(pending, pending + NUM_EVENTS, false);
+    target_end = cycle;
+  }
+#ifdef SERIALWIDGET_0
+  else if (addr == SERIALWIDGET_0(out_ready) && data) {
+    set_reg(SERIALWIDGET_0(out_valid), 0);
+    pending[SERIAL_EVENT] = false;
+  }
+#endif
+#ifdef UARTWIDGET_0
+  else if (addr == UARTWIDGET_0(out_ready) && data) {
+    set_reg(UARTWIDGET_0(out_valid), 0);
+    pending[UART_EVENT] = false;
+  }
+#endif
+#ifdef NASTIWIDGET_0
+  else if (addr == NASTIWIDGET_0(ready)) {
+    // ar, aw and w are consumed once the host is ready for them
+    set_reg(NASTIWIDGET_0(valid), reg(NASTIWIDGET_0(valid)) & ~(data & 0x1c));
+  } else if (addr == NASTIWIDGET_0(delta)) {
+    pending[MEM_EVENT] = false;
+  }
+#endif
+#ifdef ENABLE_COUNTERS
+  else if (addr == COUNTER_BAUD_RATE) {
+    set_period(COUNTER_EVENT, data);
+  }
+#endif
+}
+
+data_t simif_mock_t::read(size_t addr) {
+  MMIO_PROFILE_OP(MMIO_READ, 1, sizeof(data_t));
+  mock_wait(read_latency);
+  if (addr == MASTER(STATUS)) {
+    return model_status();
+  } else if (addr == MASTER(DONE)) {
+    return (model_status() >> MASTER(DONE_BIT)) & 0x1;
+  }
+#ifdef ENABLE_COUNTERS
+  for (size_t i = 0 ; i < NUM_TOGGLE_COUNTERS ; i++) {
+    if (addr == TOGGLE_COUNTERS[i]) {
+      // The baud ends once every counter is drained
+      if (pending[COUNTER_EVENT] && ++counter_reads == NUM_TOGGLE_COUNTERS) {
+        pending[COUNTER_EVENT] = false;
+      }
+      return cycle * (i + 1) / 8;
+    }
+  }
+#endif
+  return reg(addr);
+}
+
+ssize_t simif_mock_t::pull(size_t addr, char* data, size_t size) {
+  MMIO_PROFILE_OP(MMIO_PULL, 1, size);
+  mock_wait(dma_latency);
+  memset(data, 0, size);
+#ifdef NASTIWIDGET_0_DMA_ADDR
+  // The staged records, then empty ones, all with r and b ready
+  if (addr == NASTIWIDGET_0_DMA_ADDR) {
+    const size_t bytes = std::min(size, mem_records.size() * sizeof(uint64_t));
+    memcpy(data, mem_records.data(), bytes);
+    mem_records.erase(mem_records.begin(), mem_records.begin() + bytes / sizeof(uint64_t));
+    for (size_t off = 0 ; off + sizeof(uint64_t) <= size ; off += DMA_WIDTH) {
+      ((uint64_t*)(data + off))[0] |= 0x3;
+    }
+  }
+#endif
+  return size;
+}
+
+ssize_t simif_mock_t::push(size_t addr, char* data, size_t size) {
+  MMIO_PROFILE_OP(MMIO_PUSH, 1, size);
+  mock_wait(dma_latency);
+#ifdef NASTIWIDGET_0_DMA_ADDR
+  // A response record acts as writes of its ready bits and delta
+  if (addr == NASTIWIDGET_0_DMA_ADDR && size >= sizeof(uint64_t)) {
+    uint64_t ready;
+    memcpy(&ready, data, sizeof(ready));
+    set_reg(NASTIWIDGET_0(valid), reg(NASTIWIDGET_0(valid)) & ~(ready & 0x1c));
+    if (ready >> 32) pending[MEM_EVENT] = false;
+  }
+#endif
+  return size;
+}
@@ -0,0 +1,80 @@
+// See LICENSE for license details.
+
+#ifndef __SIMIF_MOCK_H
+#define __SIMIF_MOCK_H
+
+#include <random>
+
+#include "simif.h"
+
+// Transport backed by an in-process model of the widget register files,
+// so host code can be benchmarked without an FPGA or an RTL simulator.
+//
+// The target runs a STEP instantly unless it raises an event that needs the
+// host: a serial or UART output, a NASTI request or a toggle-counter baud.
+// It then stalls with that widget's pending bit set until the host services
+// it. Every access can be charged a fixed latency to mimic PCIe. A NASTI
+// widget with a DMA port also hands out its requests through pulls and
+// takes the answers through pushes.
+//
+// Options:
+//   +mock-latency=<ns>        cost of a register read
+//   +mock-write-latency=<ns>  cost of a register write
+//   +mock-dma-latency=<ns>    cost of a pull/push
+//   +mock-serial-period=<n>   target cycles between serial outputs
+//   +mock-uart-period=<n>     target cycles between UART outputs
+//   +mock-mem-period=<n>      target cycles between NASTI requests
+// Periods default to 0 (never). Toggle counters use the programmed baud rate.
+// Serial outputs are random words, so the mock driver pairs the model with
+// a stand-in fesvr that answers them (see rocketchip-mock.cc) rather than
+// a real one, which would take them as TSI commands.
+class simif_mock_t: public virtual simif_t
+{
+  public:
+    simif_mock_t();
+    virtual ~simif_mock_t() { }
+    virtual void init(int argc, char** argv, bool log = false);
+
+    virtual void write(size_t addr, data_t data);
+    virtual data_t read(size_t addr);
+    virtual ssize_t pull(size_t addr, char* data, size_t size);
+    virtual ssize_t push(size_t addr, char* data, size_t size);
+    virtual bool has_dma() { return true; }
+
+  protected:
+    // Sets up the model alone, for hosts that serve it to another process
+    void init_model(int argc, char** argv);
+
+  private:
+    enum event_t { SERIAL_EVENT, UART_EVENT, MEM_EVENT, COUNTER_EVENT, NUM_EVENTS };
+
+    std::vector<data_t> regs;
+    uint64_t cycle;
+    uint64_t target_end;
+    uint64_t period[NUM_EVENTS];
+    uint64_t next_event[NUM_EVENTS];
+    bool pending[NUM_EVENTS];
+    size_t num_events[NUM_EVENTS];
+    size_t counter_reads;
+    // Request records staged by a NASTI widget with DMA, in 64-bit words
+    std::vector<uint64_t> mem_records;
+    std::mt19937 mock_gen;
+
+    uint64_t read_latency;
+    uint64_t write_latency;
+    uint64_t dma_latency;
+
+    inline data_t reg(size_t addr) const {
+      return addr < regs.size() ? regs[addr] : 0;
+    }
+    inline void set_reg(size_t addr, data_t data) {
+      if (addr >= regs.size()) regs.resize(addr + 1, 0);
+      regs[addr] = data;
+    }
+    void set_period(event_t e, uint64_t p);
+    void raise(event_t e);
+    void advance();
+    data_t model_status();
+};
+
+#endif // __SIMIF_MOCK_H
@@ -23,11 +23,28 @@ simif_zynq_t::simif_zynq_t() {
 }
 
 void simif_zynq_t::write(size_t addr, uint32_t data) {
+  MMIO_PROFILE_OP(MMIO_WRITE, 1, sizeof(uint32_t));
   write_reg(addr, data);
   __sync_synchronize();
 }
 
 uint32_t simif_zynq_t::read(size_t addr) {
+  MMIO_PROFILE_OP(MMIO_READ, 1, sizeof(uint32_t));
   __sync_synchronize();
   return read_reg(addr);
 }
+
+void simif_zynq_t::flush() {
+  MMIO_PROFILE_OP(MMIO_FLUSH, batch.size(), batch.size() * sizeof(uint32_t));
+  // A single barrier on each side of the batch instead of one per access
+  __sync_synchronize();
+  for (auto& op: batch) {
+    if (op.dst) {
+      *op.dst = read_reg(op.addr);
+    } else {
+      write_reg(op.addr, op.data);
+    }
+  }
+  __sync_synchronize();
+  batch.clear();
+}
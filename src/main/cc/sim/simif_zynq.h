@@ -18,6 +18,7 @@ class simif_zynq_t: public virtual simif_t
   protected:
     virtual void write(size_t addr, uint32_t data);
     virtual uint32_t read(size_t addr);
+    virtual void flush();
     virtual ssize_t pull(size_t addr, char* data, size_t size) {
       // Not supported
       return 0;
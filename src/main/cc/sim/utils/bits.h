@@ -0,0 +1,100 @@
+// See LICENSE for license details.
+
+#ifndef __BITS_H
+#define __BITS_H
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <gmp.h>
+
+// Fixed-width bit vector of N data_t chunks, least significant chunk first.
+// Storage lives on the stack, so poking, peeking and loading memory
+// don't go through heap-allocated mpz_t values.
+template <size_t N>
+class bits {
+public:
+  static const size_t chunks = N;
+  static const size_t chunk_bits = 8 * sizeof(data_t);
+  static const size_t width = N * chunk_bits;
+
+  bits() { clear(); }
+  bits(data_t value) {
+    clear();
+    chunk[0] = value;
+  }
+  // Copies size bytes of little-endian raw data
+  bits(const void* src, size_t size) {
+    clear();
+    memcpy(chunk, src, std::min(size, sizeof(chunk)));
+  }
+
+  inline void clear() { memset(chunk, 0, sizeof(chunk)); }
+  inline data_t* data() { return chunk; }
+  inline const data_t* data() const { return chunk; }
+  inline data_t& operator[](size_t i) { return chunk[i]; }
+  inline const data_t& operator[](size_t i) const { return chunk[i]; }
+
+  inline bool operator==(const bits& that) const {
+    return memcmp(chunk, that.chunk, sizeof(chunk)) == 0;
+  }
+  inline bool operator!=(const bits& that) const { return !(*this == that); }
+
+  // Parses len hex digits, most significant first.
+  // Non-hex characters read as zero, and digits beyond the width are dropped;
+  // either makes it return false.
+  bool from_hex(const char* str, size_t len) {
+    clear();
+    bool ok = true;
+    for (size_t i = 0 ; i < len ; i++) {
+      const char c = str[len - 1 - i];
+      data_t d;
+      if (c >= '0' && c <= '9') d = c - '0';
+      else if (c >= 'a' && c <= 'f') d = c - 'a' + 10;
+      else if (c >= 'A' && c <= 'F') d = c - 'A' + 10;
+      else { ok = false; continue; }
+      if (i < width / 4) {
+        chunk[i / (chunk_bits / 4)] |= d << (4 * (i % (chunk_bits / 4)));
+      } else if (d) {
+        ok = false;
+      }
+    }
+    return ok;
+  }
+
+  // Hex string without leading zeros, as mpz_get_str(NULL, 16, ...) prints
+  std::string to_hex() const {
+    static const char digits[] = "0123456789abcdef";
+    std::string str;
+    for (size_t i = width / 4 ; i-- > 0 ; ) {
+      const size_t d = (chunk[i / (chunk_bits / 4)] >> (4 * (i % (chunk_bits / 4)))) & 0xf;
+      if (d || !str.empty() || i == 0) str += digits[d];
+    }
+    return str;
+  }
+
+  // Conversions for the mpz_t compatibility APIs.
+  // from_mpz keeps the low chunks and returns false if the value didn't fit.
+  bool from_mpz(const mpz_t value) {
+    clear();
+    size_t size;
+    if (mpz_sizeinbase(value, 2) <= width) {
+      mpz_export(chunk, &size, -1, sizeof(data_t), 0, 0, value);
+      return true;
+    }
+    data_t* wide = (data_t*)mpz_export(NULL, &size, -1, sizeof(data_t), 0, 0, value);
+    memcpy(chunk, wide, sizeof(chunk));
+    free(wide);
+    return false;
+  }
+
+  void to_mpz(mpz_t value) const {
+    mpz_import(value, N, -1, sizeof(data_t), 0, 0, chunk);
+  }
+
+private:
+  data_t chunk[N];
+};
+
+#endif // __BITS_H
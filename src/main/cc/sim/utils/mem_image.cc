@@ -0,0 +1,228 @@
+// See LICENSE for license details.
+
+#include "mem_image.h"
+#include <algorithm>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <elf.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define MEM_IMAGE_MAX_THREADS 64
+// Below this a hex file is parsed on the calling thread
+#define MEM_IMAGE_MIN_SPLIT (1UL << 20)
+// Decoded bytes handed to the writer at once
+#define MEM_IMAGE_BLOCK (1UL << 20)
+
+mem_image_t::mem_image_t(const char* filename): filename(filename), map(NULL), map_size(0) {
+  int fd = open(filename, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) < 0) {
+    fprintf(stderr, "could not open %s\n", filename);
+    exit(EXIT_FAILURE);
+  }
+  map_size = st.st_size;
+  if (map_size) {
+    void* m = mmap(NULL, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (m == MAP_FAILED) {
+      perror("mmap");
+      exit(EXIT_FAILURE);
+    }
+    // Each part of the file is read once, front to back
+    madvise(m, map_size, MADV_SEQUENTIAL);
+    map = (const char*)m;
+  }
+  close(fd);
+
+  const size_t len = strlen(filename);
+  if (map_size >= SELFMAG && !memcmp(map, ELFMAG, SELFMAG)) {
+    format = ELF;
+  } else if (len >= 4 && !strcmp(filename + len - 4, ".bin")) {
+    format = BINARY;
+  } else {
+    format = HEX;
+  }
+}
+
+mem_image_t::~mem_image_t() {
+  if (map) munmap((void*)map, map_size);
+}
+
+void mem_image_t::load(const mem_image_writer_t& write, size_t threads) {
+  if (!map_size) return;
+  switch (format) {
+    case BINARY: write(0, map, map_size); break;
+    case ELF: load_elf(write); break;
+    case HEX: load_hex(write, threads); break;
+  }
+}
+
+template <class Ehdr, class Phdr>
+static void load_elf_segments(const char* filename, const char* map, size_t map_size,
+                              const mem_image_writer_t& write) {
+  const Ehdr* eh = (const Ehdr*)map;
+  if (map_size < sizeof(Ehdr) ||
+      eh->e_phoff + (uint64_t)eh->e_phnum * sizeof(Phdr) > map_size) {
+    fprintf(stderr, "%s: truncated ELF header\n", filename);
+    exit(EXIT_FAILURE);
+  }
+  const Phdr* ph = (const Phdr*)(map + eh->e_phoff);
+  for (size_t i = 0 ; i < eh->e_phnum ; i++) {
+    if (ph[i].p_type != PT_LOAD || !ph[i].p_filesz) continue;
+    if (ph[i].p_offset + ph[i].p_filesz > map_size) {
+      fprintf(stderr, "%s: truncated segment %zu\n", filename, i);
+      exit(EXIT_FAILURE);
+    }
+    if (ph[i].p_paddr < MEM_IMAGE_ELF_BASE) {
+      fprintf(stderr, "%s: skipping segment %zu at 0x%llx below memory\n",
+              filename, i, (unsigned long long)ph[i].p_paddr);
+      continue;
+    }
+    // The store starts out zeroed, so the bss needs no writes
+    write(ph[i].p_paddr - MEM_IMAGE_ELF_BASE, map + ph[i].p_offset, ph[i].p_filesz);
+  }
+}
+
+void mem_image_t::load_elf(const mem_image_writer_t& write) {
+  if (map_size > EI_CLASS && map[EI_CLASS] == ELFCLASS32) {
+    load_elf_segments<Elf32_Ehdr, Elf32_Phdr>(filename, map, map_size, write);
+  } else {
+    load_elf_segments<Elf64_Ehdr, Elf64_Phdr>(filename, map, map_size, write);
+  }
+}
+
+// Hex digits to nibbles with no branches or tables: '0'-'9' keep their low
+// four bits, and 'a'-'f'/'A'-'F' (bit 6 set) add 9 to theirs.
+static inline uint8_t hex_nibble(char c) {
+  return (c & 0xf) + 9 * ((c >> 6) & 1);
+}
+
+// Decodes 8 hex digits, two per byte with the most significant first,
+// eight lanes at a time in a 64-bit word. Byte k of the result is the
+// k-th digit pair.
+static inline uint32_t hex_decode8(const char* s) {
+  uint64_t v;
+  memcpy(&v, s, sizeof(v));
+  v = (v & 0x0f0f0f0f0f0f0f0fULL) + 9 * ((v >> 6) & 0x0101010101010101ULL);
+  v = ((v << 4) | (v >> 8)) & 0x00ff00ff00ff00ffULL;
+  v = (v | (v >> 8)) & 0x0000ffff0000ffffULL;
+  return (uint32_t)(v | (v >> 16));
+}
+
+// A row is written most significant byte first, so out[j] is the j-th
+// digit pair from the end of the row
+static inline void hex_decode_row(const char* row, size_t len, char* out) {
+  const size_t n = len / 2;
+  size_t j = 0;
+  for ( ; j + 8 <= n ; j += 8) {
+    const char* s = row + len - 2 * (j + 8);
+    uint64_t w = hex_decode8(s) | (uint64_t)hex_decode8(s + 8) << 32;
+    w = __builtin_bswap64(w);
+    memcpy(out + j, &w, sizeof(w));
+  }
+  for ( ; j < n ; j++) {
+    const char* s = row + len - 2 * (j + 1);
+    out[j] = (hex_nibble(s[0]) << 4) | hex_nibble(s[1]);
+  }
+}
+
+// Calls f(row, len) for each line in [begin, end)
+template <class F>
+static inline void hex_for_each_row(const char* begin, const char* end, F f) {
+  while (begin < end) {
+    const char* nl = (const char*)memchr(begin, '\n', end - begin);
+    const char* row_end = nl ? nl : end;
+    size_t len = row_end - begin;
+    if (len && begin[len - 1] == '\r') len--;
+    f(begin, len);
+    begin = nl ? nl + 1 : end;
+  }
+}
+
+struct hex_part_t {
+  const char* begin;
+  const char* end;
+  uint64_t addr;
+  uint64_t bytes;
+  const mem_image_writer_t* write;
+};
+
+static void* hex_count(void* arg) {
+  hex_part_t* part = (hex_part_t*)arg;
+  uint64_t bytes = 0;
+  hex_for_each_row(part->begin, part->end, [&](const char*, size_t len) {
+    bytes += len / 2;
+  });
+  part->bytes = bytes;
+  return NULL;
+}
+
+static void* hex_decode(void* arg) {
+  hex_part_t* part = (hex_part_t*)arg;
+  std::vector<char> block(MEM_IMAGE_BLOCK);
+  uint64_t addr = part->addr;
+  size_t fill = 0;
+  hex_for_each_row(part->begin, part->end, [&](const char* row, size_t len) {
+    if (fill + len / 2 > block.size()) {
+      if (fill) (*part->write)(addr, &block[0], fill);
+      addr += fill;
+      fill = 0;
+      if (len / 2 > block.size()) block.resize(len / 2);
+    }
+    hex_decode_row(row, len, &block[fill]);
+    fill += len / 2;
+  });
+  if (fill) (*part->write)(addr, &block[0], fill);
+  return NULL;
+}
+
+// Rows are addressed by the bytes before them, so the file is split into
+// parts at line boundaries, every part counts its bytes, and then every
+// part decodes from its own start address. Both passes run in parallel.
+void mem_image_t::load_hex(const mem_image_writer_t& write, size_t threads) {
+  if (!threads) threads = sysconf(_SC_NPROCESSORS_ONLN);
+  threads = std::max<size_t>(1, std::min<size_t>(threads, MEM_IMAGE_MAX_THREADS));
+  if (map_size < MEM_IMAGE_MIN_SPLIT) threads = 1;
+
+  hex_part_t parts[MEM_IMAGE_MAX_THREADS];
+  const char* end = map + map_size;
+  const char* begin = map;
+  for (size_t i = 0 ; i < threads ; i++) {
+    const char* split = i + 1 == threads ? end : map + map_size / threads * (i + 1);
+    if (split < begin) split = begin;
+    const char* nl = (const char*)memchr(split, '\n', end - split);
+    split = nl ? nl + 1 : end;
+    parts[i].begin = begin;
+    parts[i].end = split;
+    parts[i].bytes = 0;
+    parts[i].write = &write;
+    begin = split;
+  }
+
+  auto run = [&](void* (*f)(void*)) {
+    pthread_t workers[MEM_IMAGE_MAX_THREADS];
+    for (size_t i = 1 ; i < threads ; i++) {
+      if (pthread_create(&workers[i], NULL, f, &parts[i])) {
+        fprintf(stderr, "Cannot start a loadmem thread\n");
+        abort();
+      }
+    }
+    f(&parts[0]);
+    for (size_t i = 1 ; i < threads ; i++) {
+      pthread_join(workers[i], NULL);
+    }
+  };
+
+  if (threads > 1) run(hex_count);
+  uint64_t addr = 0;
+  for (size_t i = 0 ; i < threads ; i++) {
+    parts[i].addr = addr;
+    addr += parts[i].bytes;
+  }
+  run(hex_decode);
+}
@@ -0,0 +1,47 @@
+// See LICENSE for license details.
+
+#ifndef __MEM_IMAGE_H
+#define __MEM_IMAGE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+
+// rocket-chip places DRAM here; ELF segments are loaded relative to it,
+// so offset 0 of an image is the first byte of target memory as in hex
+#ifndef MEM_IMAGE_ELF_BASE
+#define MEM_IMAGE_ELF_BASE 0x80000000ULL
+#endif
+
+// Receives size bytes at offset addr of target memory
+typedef std::function<void(uint64_t addr, const char* data, size_t size)> mem_image_writer_t;
+
+// A target memory image mapped read-only from a file, in one of:
+//  - hex: one row per line, most significant byte first, as elf2hex emits
+//  - ELF: PT_LOAD segments at their physical address
+//  - binary (*.bin): raw bytes from offset 0
+class mem_image_t
+{
+ public:
+  // Exits if the file can't be opened, like load_mem always has
+  mem_image_t(const char* filename);
+  ~mem_image_t();
+
+  // Hands every range of the image to write. Binary files and ELF segments
+  // are passed straight out of the mapping so the writer can memcpy them;
+  // hex rows are decoded in blocks on up to threads threads (0 for one per
+  // CPU), so write must be safe to call concurrently on disjoint ranges.
+  void load(const mem_image_writer_t& write, size_t threads = 0);
+
+ private:
+  enum format_t { HEX, ELF, BINARY };
+  const char* filename;
+  const char* map;
+  size_t map_size;
+  format_t format;
+
+  void load_elf(const mem_image_writer_t& write);
+  void load_hex(const mem_image_writer_t& write, size_t threads);
+};
+
+#endif // __MEM_IMAGE_H
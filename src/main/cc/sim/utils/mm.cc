@@ -1,12 +1,96 @@
 // See LICENSE for license details.
 
 #include "mm.h"
-#include <iostream>
-#include <fstream>
+#include "mm_dramsim2.h"
+#include "mm_ddr3.h"
+#include "mm_latency_pipe.h"
+#include "mm_profile.h"
+#include "mem_image.h"
+#include <algorithm>
 #include <cstdlib>
 #include <cstring>
 #include <string>
 #include <cassert>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifndef MAP_HUGETLB
+#define MAP_HUGETLB 0x40000
+#endif
+#define MM_HUGE_PAGE_SIZE (2UL << 20)
+
+bool mm_parse_pages(const std::string& arg, mm_pages_t* pages) {
+  if (arg.find("+mem-hugepages=") != 0) return false;
+  std::string mode = arg.substr(15);
+  if (mode == "thp") {
+    *pages = MM_PAGES_THP;
+  } else if (mode == "hugetlb") {
+    *pages = MM_PAGES_HUGETLB;
+  } else {
+    fprintf(stderr, "Unknown +mem-hugepages mode %s\n", mode.c_str());
+    *pages = MM_PAGES_DEFAULT;
+  }
+  return true;
+}
+
+bool mm_parse_image(const std::string& arg, std::string* image, std::string* save_image) {
+  if (arg.find("+mem-image=") == 0) {
+    *image = arg.substr(11);
+  } else if (arg.find("+save-mem-image=") == 0) {
+    *save_image = arg.substr(16);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool mm_parse_sched(const std::string& arg, mm_sched_t* sched, uint64_t* seed) {
+  if (arg.find("+mm-sched=") == 0) {
+    std::string mode = arg.substr(10);
+    if (mode == "round-robin") {
+      *sched = MM_SCHED_ROUND_ROBIN;
+    } else if (mode == "random") {
+      *sched = MM_SCHED_RANDOM;
+    } else {
+      if (mode != "in-order") fprintf(stderr, "Unknown +mm-sched order %s\n", mode.c_str());
+      *sched = MM_SCHED_IN_ORDER;
+    }
+  } else if (arg.find("+mm-sched-seed=") == 0) {
+    *seed = strtoull(arg.c_str() + 15, NULL, 10);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool mm_parse_model(const std::string& arg, mm_model_t* model) {
+  if (arg.find("+dramsim") == 0) {
+    *model = MM_MODEL_DRAMSIM2;
+  } else if (arg.find("+ddr3") == 0) {
+    // Held back until mm-bench has checked it against DRAMSim2
+#ifdef ENABLE_MM_DDR3
+    *model = MM_MODEL_DDR3;
+#else
+    fprintf(stderr, "+ddr3 is not validated against DRAMSim2 yet, build with MM_DDR3=1 to use it\n");
+#endif
+  } else if (arg.find("+latency-pipe") == 0) {
+    *model = MM_MODEL_LATENCY_PIPE;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+mm_t* mm_new(mm_model_t model) {
+  switch (model) {
+    case MM_MODEL_DRAMSIM2: return new mm_dramsim2_t;
+    case MM_MODEL_DDR3: return new mm_ddr3_t;
+    case MM_MODEL_LATENCY_PIPE: return new mm_latency_pipe_t;
+    default: return new mm_magic_t;
+  }
+}
 
 void mm_base_t::write(uint64_t addr, uint8_t *data) {
   addr %= this->size;
@@ -41,13 +125,161 @@ void mm_base_t::init(size_t sz, int wsz, int lsz)
   assert(wsz > 0 && lsz > 0 && (lsz & (lsz-1)) == 0 && lsz % wsz == 0);
   word_size = wsz;
   line_size = lsz;
-  data = new uint8_t[sz];
   size = sz;
+
+  const int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+  void* mem = MAP_FAILED;
+  if (!image.empty()) {
+    map_image();
+    return;
+  }
+  if (pages == MM_PAGES_HUGETLB) {
+    map_size = (sz + MM_HUGE_PAGE_SIZE - 1) & ~(MM_HUGE_PAGE_SIZE - 1);
+    // Reserved up front: without a reservation a fault past the pool is SIGBUS
+    mem = mmap(NULL, map_size, PROT_READ | PROT_WRITE,
+               (flags & ~MAP_NORESERVE) | MAP_HUGETLB, -1, 0);
+    if (mem == MAP_FAILED) {
+      fprintf(stderr, "No huge pages reserved for %zu bytes, using regular pages\n", map_size);
+    }
+  }
+  if (mem == MAP_FAILED) {
+    map_size = sz;
+    mem = mmap(NULL, map_size, PROT_READ | PROT_WRITE, flags, -1, 0);
+  }
+  if (mem == MAP_FAILED) {
+    perror("mmap");
+    abort();
+  }
+#ifdef MADV_HUGEPAGE
+  if (pages == MM_PAGES_THP) madvise(mem, map_size, MADV_HUGEPAGE);
+#endif
+  data = (uint8_t*)mem;
+}
+
+void mm_base_t::map_image()
+{
+  const size_t page_size = sysconf(_SC_PAGESIZE);
+  int fd = open(image.c_str(), O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) < 0) {
+    fprintf(stderr, "could not open %s\n", image.c_str());
+    exit(EXIT_FAILURE);
+  }
+  if (image_offset % page_size) {
+    fprintf(stderr, "%s: offset 0x%zx is not page aligned\n", image.c_str(), image_offset);
+    exit(EXIT_FAILURE);
+  }
+  size_t image_size = (size_t)st.st_size > image_offset ? st.st_size - image_offset : 0;
+  if (image_size > size) {
+    fprintf(stderr, "%s: image is larger than the memory, ignoring the rest\n", image.c_str());
+    image_size = size;
+  }
+  // Anonymous zero pages past the end of the image, as in a fresh store.
+  // Huge pages don't apply: the pages come from the page cache.
+  map_size = size;
+  void* mem = mmap(NULL, map_size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (mem != MAP_FAILED && image_size) {
+    const size_t len = (image_size + page_size - 1) & ~(page_size - 1);
+    if (mmap(mem, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED,
+             fd, image_offset) == MAP_FAILED) {
+      munmap(mem, map_size);
+      mem = MAP_FAILED;
+    }
+  }
+  close(fd);
+  if (mem == MAP_FAILED) {
+    perror("mmap");
+    abort();
+  }
+  data = (uint8_t*)mem;
+}
+
+bool mm_base_t::save_image(const std::string& filename, size_t offset) const
+{
+  int fd = open(filename.c_str(), O_WRONLY | O_CREAT | (offset ? 0 : O_TRUNC), 0644);
+  if (fd < 0) {
+    fprintf(stderr, "could not open %s\n", filename.c_str());
+    return false;
+  }
+  // Pages never touched are zero, so only resident pages are looked at,
+  // except under an image where evicted pages still hold its data
+  const size_t page_size = sysconf(_SC_PAGESIZE);
+  const size_t chunk_pages = 1 << 16;
+  std::vector<unsigned char> vec(chunk_pages);
+  std::vector<char> zero(page_size);
+  bool ok = true;
+  for (size_t off = 0 ; ok && off < size ; off += chunk_pages * page_size) {
+    const size_t len = std::min(size - off, chunk_pages * page_size);
+    if (image.empty() && mincore(data + off, len, &vec[0])) {
+      ok = false;
+      break;
+    }
+    for (size_t i = 0 ; ok && i * page_size < len ; i++) {
+      if (image.empty() && !(vec[i] & 0x1)) continue;
+      const size_t page = std::min(page_size, len - i * page_size);
+      const uint8_t* src = data + off + i * page_size;
+      if (!memcmp(src, &zero[0], page)) continue;
+      ok = pwrite(fd, src, page, offset + off + i * page_size) == (ssize_t)page;
+    }
+  }
+  struct stat st;
+  if (ok && fstat(fd, &st) == 0 && (size_t)st.st_size < offset + size) {
+    ok = ftruncate(fd, offset + size) == 0;
+  }
+  close(fd);
+  if (!ok) perror(filename.c_str());
+  return ok;
+}
+
+size_t mm_base_t::resident_size() const
+{
+  if (!data) return 0;
+  const size_t page_size = sysconf(_SC_PAGESIZE);
+  const size_t chunk_pages = 1 << 16;
+  std::vector<unsigned char> vec(chunk_pages);
+  size_t resident = 0;
+  for (size_t off = 0 ; off < map_size ; off += chunk_pages * page_size) {
+    size_t len = std::min(map_size - off, chunk_pages * page_size);
+    if (mincore(data + off, len, &vec[0])) return 0;
+    for (size_t i = 0 ; i < (len + page_size - 1) / page_size ; i++) {
+      resident += vec[i] & 0x1;
+    }
+  }
+  return std::min(resident * page_size, size);
+}
+
+void mm_base_t::print_stats(FILE* file) const
+{
+  const size_t resident = resident_size();
+  fprintf(file, "Memory touched: %.1f MiB of %.1f MiB (%.2f%%)\n",
+    resident / (double)(1 << 20), size / (double)(1 << 20),
+    size ? 100.0 * resident / size : 0.0);
+}
+
+void mm_base_t::close_profile()
+{
+#ifdef ENABLE_MM_PROFILE
+  delete profile;
+  profile = NULL;
+#endif
 }
 
 mm_base_t::~mm_base_t()
 {
-  delete [] data;
+  close_profile();
+  if (data) munmap(data, map_size);
+}
+
+void mm_t::idle(uint64_t cycles)
+{
+  for (uint64_t i = 0 ; i < cycles ; i++) {
+    tick(false,
+         false, 0, 0, 0, 0,
+         false, 0, 0, 0, 0,
+         false, 0, NULL, false,
+         false, false);
+  }
 }
 
 void mm_magic_t::init(size_t sz, int wsz, int lsz)
@@ -56,6 +288,18 @@ void mm_magic_t::init(size_t sz, int wsz, int lsz)
   dummy_data.resize(word_size);
 }
 
+void mm_magic_t::parse_args(const std::vector<std::string>& args)
+{
+  mm_sched_t sched = MM_SCHED_IN_ORDER;
+  uint64_t seed = 0;
+  for (auto &arg: args) {
+    mm_parse_sched(arg, &sched, &seed);
+  }
+  rresp.set_sched(sched, seed);
+  // Apart from the reads, so writes don't take up the read order's draws
+  bresp.set_sched(sched, seed + 1);
+}
+
 void mm_magic_t::tick(
   bool reset,
   bool ar_valid,
@@ -85,14 +329,13 @@ void mm_magic_t::tick(
   bool b_fire = !reset && b_valid() && b_ready;
 
   if (ar_fire) {
+    MM_PROFILE_ACCESS(cycle, ar_addr % size, (ar_len + 1) << ar_size, ar_id, false);
     uint64_t start_addr = (ar_addr / word_size) * word_size;
-    for (size_t i = 0; i <= ar_len; i++) {
-      auto dat = read(start_addr + i * word_size);
-      rresp.push(mm_rresp_t(ar_id, dat, i == ar_len));
-    }
+    rresp.push(mm_rresp_t(ar_id, start_addr % size, ar_len + 1));
   }
 
   if (aw_fire) {
+    MM_PROFILE_ACCESS(cycle, aw_addr % size, (aw_len + 1) << aw_size, aw_id, true);
     store_addr = aw_addr;
     store_id = aw_id;
     store_count = aw_len + 1;
@@ -116,7 +359,7 @@ void mm_magic_t::tick(
     bresp.pop();
 
   if (r_fire)
-    rresp.pop();
+    r_advance(rresp);
 
   cycle++;
 
@@ -127,29 +370,29 @@ void mm_magic_t::tick(
   }
 }
 
-void load_mem(void** mems, const char* fn, int line_size, int nchannels)
+void load_mem(void** mems, const char* fn, int line_size, int nchannels, size_t size)
 {
-  char* m;
-  int start = 0;
-  std::ifstream in(fn);
-  if (!in)
-  {
-    std::cerr << "could not open " << fn << std::endl;
-    exit(EXIT_FAILURE);
-  }
-
-  std::string line;
-  while (std::getline(in, line))
-  {
-    #define parse_nibble(c) ((c) >= 'a' ? (c)-'a'+10 : (c)-'0')
-    for (int i = line.length()-2, j = 0; i >= 0; i -= 2, j++) {
-      char data = (parse_nibble(line[i]) << 4) | parse_nibble(line[i+1]);
-      int addr = start + j;
-      int channel = (addr / line_size) % nchannels;
-      m = (char *) mems[channel];
-      addr = (addr / line_size / nchannels) * line_size + (addr % line_size);
-      m[addr] = data;
+  mem_image_t image(fn);
+  image.load([=](uint64_t addr, const char* src, size_t len) {
+    if (addr + len > size) {
+      fprintf(stderr, "%s: 0x%llx bytes at 0x%llx don't fit in memory\n",
+              fn, (unsigned long long)len, (unsigned long long)addr);
+      exit(EXIT_FAILURE);
     }
-    start += line.length()/2;
-  }
+    if (nchannels == 1) {
+      memcpy((char*)mems[0] + addr, src, len);
+      return;
+    }
+    // Lines are interleaved across channels
+    while (len) {
+      const size_t off = addr % line_size;
+      const size_t n = std::min<size_t>(len, line_size - off);
+      const size_t channel = (addr / line_size) % nchannels;
+      const size_t local = (addr / line_size / nchannels) * line_size + off;
+      memcpy((char*)mems[channel] + local, src, n);
+      addr += n;
+      src += n;
+      len -= n;
+    }
+  });
 }
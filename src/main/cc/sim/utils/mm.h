@@ -4,14 +4,168 @@
 #define MM_EMULATOR_H
 
 #include <stdint.h>
+#include <stdio.h>
 #include <cstring>
+#include <iterator>
+#include <map>
 #include <queue>
+#include <random>
+#include <string>
+#include <vector>
+
+// How the backing store is paged. Huge pages cut TLB misses on big
+// memories; hugetlb needs pages reserved in /proc/sys/vm/nr_hugepages.
+enum mm_pages_t {
+  MM_PAGES_DEFAULT,
+  MM_PAGES_THP,     // transparent huge pages (madvise)
+  MM_PAGES_HUGETLB  // explicit huge pages (MAP_HUGETLB)
+};
+
+// Parses +mem-hugepages=thp|hugetlb, returning false for other arguments
+bool mm_parse_pages(const std::string& arg, mm_pages_t* pages);
+
+// Parses +mem-image=<file> (map a saved image instead of loading) and
+// +save-mem-image=<file> (save the store once it is loaded), returning
+// false for other arguments
+bool mm_parse_image(const std::string& arg, std::string* image, std::string* save_image);
+
+// A read burst waiting on the R channel. It points into the backing store
+// rather than holding a copy, so a beat is only read when r_data() is
+// sampled and queueing a burst costs no allocation.
+struct mm_rresp_t
+{
+  uint64_t id;
+  uint64_t addr; // offset of the current beat in the store
+  uint64_t beats; // beats left, including the current one
+
+  mm_rresp_t(uint64_t id, uint64_t addr, uint64_t beats)
+  {
+    this->id = id;
+    this->addr = addr;
+    this->beats = beats;
+  }
+
+  mm_rresp_t()
+  {
+    this->id = 0;
+    this->addr = 0;
+    this->beats = 0;
+  }
+};
+
+// Order the magic model answers requests of different AXI IDs in.
+// Requests of one ID are always answered in order, and a read burst is
+// never interleaved with another.
+enum mm_sched_t {
+  MM_SCHED_IN_ORDER,    // in the order they are accepted
+  MM_SCHED_ROUND_ROBIN, // one burst per waiting ID in turn
+  MM_SCHED_RANDOM       // a waiting ID at random, from +mm-sched-seed
+};
+
+// Parses +mm-sched=in-order|round-robin|random and +mm-sched-seed=<n>,
+// returning false for other arguments
+bool mm_parse_sched(const std::string& arg, mm_sched_t* sched, uint64_t* seed);
+
+inline uint64_t mm_resp_id(const mm_rresp_t& resp) { return resp.id; }
+inline uint64_t mm_resp_id(uint64_t id) { return id; }
+
+// A response queue with the interface of std::queue, answering in the
+// order sched picks. front() is the response being returned; it stays
+// picked until it is popped, so a burst can take several pops' worth of
+// beats through front() before it goes.
+template <class T>
+class mm_resp_queue_t
+{
+ public:
+  mm_resp_queue_t(): sched(MM_SCHED_IN_ORDER), count(0), picked(false), last(~0ULL) { }
+
+  // Only while the queue is empty
+  void set_sched(mm_sched_t s, uint64_t seed) {
+    sched = s;
+    gen.seed(seed);
+  }
+
+  bool empty() const { return count == 0; }
+  size_t size() const { return count; }
+
+  void push(const T& resp) {
+    if (sched == MM_SCHED_IN_ORDER) {
+      fifo.push(resp);
+    } else {
+      // Iterators stay valid through insertion, so a pick survives this
+      ids[mm_resp_id(resp)].push(resp);
+    }
+    count++;
+  }
+
+  T& front() {
+    if (sched == MM_SCHED_IN_ORDER) return fifo.front();
+    if (!picked) pick();
+    return cur->second.front();
+  }
+
+  void pop() {
+    count--;
+    if (sched == MM_SCHED_IN_ORDER) {
+      fifo.pop();
+      return;
+    }
+    if (!picked) pick();
+    cur->second.pop();
+    if (cur->second.empty()) ids.erase(cur);
+    picked = false;
+  }
+
+ private:
+  typedef std::map<uint64_t, std::queue<T> > id_map_t;
+
+  mm_sched_t sched;
+  std::mt19937_64 gen;
+  std::queue<T> fifo;
+  id_map_t ids; // waiting IDs only
+  size_t count;
+  bool picked;
+  typename id_map_t::iterator cur;
+  uint64_t last; // ID picked last
+
+  void pick() {
+    if (sched == MM_SCHED_ROUND_ROBIN) {
+      cur = ids.upper_bound(last);
+      if (cur == ids.end()) cur = ids.begin();
+    } else {
+      cur = ids.begin();
+      std::advance(cur, gen() % ids.size());
+    }
+    last = cur->first;
+    picked = true;
+  }
+};
+
+class mm_profile_t;
 
 class mm_base_t
 {
  public:
-  mm_base_t(): data(0), size(0) {}
+  mm_base_t(): data(0), size(0), map_size(0), pages(MM_PAGES_DEFAULT), image_offset(0)
+#ifdef ENABLE_MM_PROFILE
+    , profile(0)
+#endif
+    {}
+  // The store is reserved, not committed: pages are zero-filled by the
+  // kernel on first touch, so memory use follows what the target touches
   virtual void init(size_t sz, int word_size, int line_size);
+  void set_pages(mm_pages_t p) { pages = p; }
+  // Starts the store from a saved image, mapped copy-on-write from
+  // offset bytes into the file, so runs from one image share its pages
+  // until they write them. Takes effect at init().
+  void set_image(const std::string& filename, size_t offset = 0) {
+    image = filename;
+    image_offset = offset;
+  }
+  // Writes the store to filename at offset, leaving zero pages as holes.
+  // Offset 0 truncates the file first, so stores can be saved one after
+  // another into one image.
+  bool save_image(const std::string& filename, size_t offset = 0) const;
   virtual void* get_data() { return data; }
   virtual size_t get_size() { return size; }
   virtual size_t get_word_size() { return word_size; }
@@ -21,19 +175,62 @@ class mm_base_t
   void write(uint64_t addr, uint8_t *data, uint64_t strb, uint64_t size);
   std::vector<char> read(uint64_t addr);
 
+  // Bytes of the store backed by memory, i.e. touched so far
+  size_t resident_size() const;
+  virtual void print_stats(FILE* file) const;
+
+#ifdef ENABLE_MM_PROFILE
+  // Takes ownership of p, closing any profile attached before
+  void set_profile(mm_profile_t* p) { close_profile(); profile = p; }
+#endif
+  // Writes out and drops the access profile, if any
+  void close_profile();
+
   virtual ~mm_base_t();
 
  protected:
   uint8_t* data;
   size_t size;
+  size_t map_size;
+  mm_pages_t pages;
+  std::string image;
+  size_t image_offset;
   int word_size;
   int line_size;
+#ifdef ENABLE_MM_PROFILE
+  mm_profile_t* profile;
+#endif
+
+  void map_image();
+
+  // R channel helpers for models queueing mm_rresp_t bursts
+  void *r_beat(const mm_rresp_t& resp) { return data + resp.addr; }
+  template <class Q>
+  void r_advance(Q& rresp) {
+    mm_rresp_t& resp = rresp.front();
+    if (--resp.beats == 0) {
+      rresp.pop();
+    } else {
+      resp.addr = (resp.addr + word_size) % size;
+    }
+  }
 };
 
 
 class mm_t: public mm_base_t
 {
  public:
+  // Model-specific plusargs, given before the first tick
+  virtual void parse_args(const std::vector<std::string>& args) { }
+
+  // Target cycles, counting the one just ticked, until a response can
+  // next fall due with no new requests. The driver may let the target
+  // run that far on one delta, stepping the model over the rest with
+  // idle(). Models that can't tell answer 1, i.e. lockstep.
+  virtual uint64_t run_ahead() { return 1; }
+  // Steps the model cycles times with nothing valid and nothing ready
+  virtual void idle(uint64_t cycles);
+
   virtual bool ar_ready() = 0;
   virtual bool aw_ready() = 0;
   virtual bool w_ready() = 0;
@@ -72,32 +269,14 @@ class mm_t: public mm_base_t
   ) = 0;
 };
 
-struct mm_rresp_t
-{
-  uint64_t id;
-  std::vector<char> data;
-  bool last;
-
-  mm_rresp_t(uint64_t id, std::vector<char> data, bool last)
-  {
-    this->id = id;
-    this->data = data;
-    this->last = last;
-  }
-
-  mm_rresp_t()
-  {
-    this->id = 0;
-    this->last = false;
-  }
-};
-
 class mm_magic_t : public mm_t
 {
  public:
-  mm_magic_t() : store_inflight(false) {}
+  mm_magic_t() : store_inflight(false), cycle(0) {}
 
   virtual void init(size_t sz, int word_size, int line_size);
+  // Takes the response order from +mm-sched and +mm-sched-seed
+  virtual void parse_args(const std::vector<std::string>& args);
 
   virtual bool ar_ready() { return true; }
   virtual bool aw_ready() { return !store_inflight; }
@@ -108,8 +287,8 @@ class mm_magic_t : public mm_t
   virtual bool r_valid() { return !rresp.empty(); }
   virtual uint64_t r_resp() { return 0; }
   virtual uint64_t r_id() { return r_valid() ? rresp.front().id: 0; }
-  virtual void *r_data() { return r_valid() ? &rresp.front().data[0] : &dummy_data[0]; }
-  virtual bool r_last() { return r_valid() ? rresp.front().last : false; }
+  virtual void *r_data() { return r_valid() ? r_beat(rresp.front()) : &dummy_data[0]; }
+  virtual bool r_last() { return r_valid() ? rresp.front().beats == 1 : false; }
 
   virtual void tick
   (
@@ -143,12 +322,26 @@ class mm_magic_t : public mm_t
   uint64_t store_size;
   uint64_t store_count;
   std::vector<char> dummy_data;
-  std::queue<uint64_t> bresp;
+  mm_resp_queue_t<uint64_t> bresp;
 
-  std::queue<mm_rresp_t> rresp;
+  mm_resp_queue_t<mm_rresp_t> rresp;
 
   uint64_t cycle;
 };
 
-void load_mem(void** mems, const char* fn, int line_size, int nchannels);
+// Timing models behind the memory slave
+enum mm_model_t {
+  MM_MODEL_MAGIC,    // fixed single-cycle latency
+  MM_MODEL_DRAMSIM2, // cycle-accurate DRAMSim2 (+dramsim)
+  MM_MODEL_DDR3,     // analytical DDR3 bank timing (+ddr3, with ENABLE_MM_DDR3)
+  MM_MODEL_LATENCY_PIPE // SimpleLatencyPipe timing, set by +mm_* (+latency-pipe)
+};
+
+// Parses +dramsim, +ddr3 and +latency-pipe, returning false for other arguments
+bool mm_parse_model(const std::string& arg, mm_model_t* model);
+mm_t* mm_new(mm_model_t model);
+
+// Loads a hex, ELF or binary image (see mem_image_t) into size bytes of
+// memory, interleaved by line across nchannels stores
+void load_mem(void** mems, const char* fn, int line_size, int nchannels, size_t size);
 #endif
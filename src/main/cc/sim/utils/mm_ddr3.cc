@@ -0,0 +1,276 @@
+// See LICENSE for license details.
+
+#include "mm_ddr3.h"
+#include "mm_profile.h"
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <cstdlib>
+#include <cassert>
+
+mm_ddr3_config_t::mm_ddr3_config_t():
+  banks(8), rows(32768), cols(2048), device_width(4), bus_bits(64),
+  queue_depth(32), open_page(true),
+  CL(10), AL(0), BL(8), tRAS(24), tRCD(10), tRRD(4), tRC(34), tRP(10),
+  tCCD(4), tRTP(5), tWTR(5), tWR(10), tRFC(107), tREFI(5200) { }
+
+static void parse_ini(const std::string& filename,
+                      std::map<std::string, std::string>& kv) {
+  std::ifstream in(filename.c_str());
+  if (!in) {
+    fprintf(stderr, "DDR3 model: cannot open %s, using defaults\n", filename.c_str());
+    return;
+  }
+  std::string line;
+  while (std::getline(in, line)) {
+    line = line.substr(0, line.find(';'));
+    size_t eq = line.find('=');
+    if (eq == std::string::npos) continue;
+    std::string key = line.substr(0, eq), value = line.substr(eq + 1);
+    key.erase(0, key.find_first_not_of(" \t"));
+    key.erase(key.find_last_not_of(" \t\r") + 1);
+    value.erase(0, value.find_first_not_of(" \t"));
+    value.erase(value.find_last_not_of(" \t\r") + 1);
+    kv[key] = value;
+  }
+}
+
+void mm_ddr3_config_t::load(const std::string& device_ini, const std::string& system_ini) {
+  std::map<std::string, std::string> kv;
+  parse_ini(device_ini, kv);
+  parse_ini(system_ini, kv);
+  #define INI_PARAM(key, field) \
+    if (kv.count(key)) field = strtoull(kv[key].c_str(), NULL, 10);
+  INI_PARAM("NUM_BANKS", banks)
+  INI_PARAM("NUM_ROWS", rows)
+  INI_PARAM("NUM_COLS", cols)
+  INI_PARAM("DEVICE_WIDTH", device_width)
+  INI_PARAM("JEDEC_DATA_BUS_BITS", bus_bits)
+  INI_PARAM("TRANS_QUEUE_DEPTH", queue_depth)
+  INI_PARAM("CL", CL)
+  INI_PARAM("AL", AL)
+  INI_PARAM("BL", BL)
+  INI_PARAM("tRAS", tRAS)
+  INI_PARAM("tRCD", tRCD)
+  INI_PARAM("tRRD", tRRD)
+  INI_PARAM("tRC", tRC)
+  INI_PARAM("tRP", tRP)
+  INI_PARAM("tCCD", tCCD)
+  INI_PARAM("tRTP", tRTP)
+  INI_PARAM("tWTR", tWTR)
+  INI_PARAM("tWR", tWR)
+  INI_PARAM("tRFC", tRFC)
+  #undef INI_PARAM
+  if (kv.count("ROW_BUFFER_POLICY")) {
+    open_page = kv["ROW_BUFFER_POLICY"] != "close_page";
+  }
+  // The refresh interval is given in ns
+  if (kv.count("REFRESH_PERIOD") && kv.count("tCK")) {
+    tREFI = strtod(kv["REFRESH_PERIOD"].c_str(), NULL) /
+            strtod(kv["tCK"].c_str(), NULL);
+  }
+}
+
+void mm_ddr3_t::init(size_t sz, int wsz, int lsz)
+{
+  mm_t::init(sz, wsz, lsz);
+  dummy_data.resize(word_size);
+
+#ifndef _WIN32
+  std::string pwd = "dramsim2_ini/";
+#else
+  std::string pwd = "";
+#endif
+  config.load(pwd + "DDR3_micron_64M_8B_x4_sg15.ini", pwd + "system.ini");
+  assert(config.banks > 0 && config.BL > 0 && config.queue_depth > 0);
+
+  const size_t rank_size = config.rows * config.cols * config.banks * config.bus_bits / 8;
+  ranks = std::max<size_t>(1, size / rank_size);
+  bank_state.resize(ranks * config.banks);
+  reset_timing();
+}
+
+void mm_ddr3_t::reset_timing()
+{
+  for (auto& b: bank_state) {
+    b.open = false;
+    b.row = 0;
+    b.next_act = b.next_pre = b.next_cas = 0;
+  }
+  bus_free = next_act = next_read = 0;
+  next_refresh = config.tREFI;
+  row_hits = row_misses = 0;
+}
+
+void mm_ddr3_t::refresh(uint64_t until)
+{
+  if (next_refresh > until) return;
+  // Only the latest refresh before a request can still hold it up
+  next_refresh += (until - next_refresh) / config.tREFI * config.tREFI;
+  uint64_t start = next_refresh;
+  bool open = false;
+  for (auto& b: bank_state) {
+    start = std::max(start, b.next_pre);
+    open |= b.open;
+  }
+  // Precharge all, then refresh all banks
+  const uint64_t done = start + (open ? config.tRP : 0) + config.tRFC;
+  for (auto& b: bank_state) {
+    b.open = false;
+    b.next_act = std::max(b.next_act, done);
+  }
+  next_refresh += config.tREFI;
+}
+
+uint64_t mm_ddr3_t::schedule(uint64_t addr, bool write)
+{
+  const uint64_t RL = config.AL + config.CL;
+  const uint64_t WL = RL - 1;
+  const uint64_t burst = config.BL / 2;
+
+  // Address mapping scheme2 of DRAMSim2: row:col:bank:rank:offset
+  const uint64_t line = (addr % size) / (config.bus_bits / 8 * config.BL);
+  const uint64_t bank_idx = line % (ranks * config.banks);
+  const uint64_t row = line / (ranks * config.banks * (config.cols / config.BL));
+  bank_t& b = bank_state[bank_idx];
+
+  const uint64_t t = cycle + 1;
+  refresh(t);
+
+  uint64_t cas;
+  if (b.open && b.row == row) {
+    row_hits++;
+    cas = std::max(t, b.next_cas);
+  } else {
+    row_misses++;
+    uint64_t act = std::max(t, std::max(b.next_act, next_act));
+    if (b.open) act = std::max(act, std::max(t, b.next_pre) + config.tRP);
+    b.open = true;
+    b.row = row;
+    b.next_pre = act + config.tRAS;
+    b.next_act = act + config.tRC;
+    next_act = act + config.tRRD;
+    cas = act + config.tRCD;
+  }
+  if (!write) cas = std::max(cas, next_read);
+
+  // The data bus is shared, so transactions complete in order
+  const uint64_t latency = write ? WL : RL;
+  const uint64_t data = std::max(cas + latency, bus_free);
+  cas = data - latency;
+  bus_free = data + burst;
+  b.next_cas = cas + config.tCCD;
+  if (write) {
+    b.next_pre = std::max(b.next_pre, bus_free + config.tWR);
+    next_read = std::max(next_read, bus_free + config.tWTR);
+  } else {
+    b.next_pre = std::max(b.next_pre, cas + config.AL + config.tRTP);
+  }
+  if (!config.open_page) {
+    b.open = false;
+    b.next_act = std::max(b.next_act, b.next_pre + config.tRP);
+  }
+  return bus_free;
+}
+
+// A transaction completing at cycle t is answered by the tick starting
+// at t, and ticks with no requests change nothing else
+uint64_t mm_ddr3_t::run_ahead()
+{
+  if (store_inflight || !rresp.empty() || !bresp.empty() ||
+      (rreq.empty() && wreq.empty())) return 1;
+  uint64_t due = UINT64_MAX;
+  if (!rreq.empty()) due = std::min(due, rreq.front().first);
+  if (!wreq.empty()) due = std::min(due, wreq.front().first);
+  return due >= cycle ? due - cycle + 1 : 1;
+}
+
+void mm_ddr3_t::tick(
+  bool reset,
+
+  bool ar_valid,
+  uint64_t ar_addr,
+  uint64_t ar_id,
+  uint64_t ar_size,
+  uint64_t ar_len,
+
+  bool aw_valid,
+  uint64_t aw_addr,
+  uint64_t aw_id,
+  uint64_t aw_size,
+  uint64_t aw_len,
+
+  bool w_valid,
+  uint64_t w_strb,
+  void *w_data,
+  bool w_last,
+
+  bool r_ready,
+  bool b_ready)
+{
+  bool ar_fire = !reset && ar_valid && ar_ready();
+  bool aw_fire = !reset && aw_valid && aw_ready();
+  bool w_fire = !reset && w_valid && w_ready();
+  bool r_fire = !reset && r_valid() && r_ready;
+  bool b_fire = !reset && b_valid() && b_ready;
+
+  if (ar_fire) {
+    MM_PROFILE_ACCESS(cycle, ar_addr % size, (ar_len + 1) << ar_size, ar_id, false);
+    uint64_t start_addr = (ar_addr / word_size) * word_size;
+    rreq.push(std::make_pair(schedule(ar_addr, false),
+      mm_rresp_t(ar_id, start_addr % size, ar_len + 1)));
+    inflight++;
+  }
+
+  if (aw_fire) {
+    MM_PROFILE_ACCESS(cycle, aw_addr % size, (aw_len + 1) << aw_size, aw_id, true);
+    store_addr = aw_addr;
+    store_id = aw_id;
+    store_count = aw_len + 1;
+    store_size = 1 << aw_size;
+    store_inflight = true;
+  }
+
+  if (w_fire) {
+    write(store_addr, (uint8_t*)w_data, w_strb, store_size);
+    store_addr += store_size;
+    store_count--;
+
+    if (store_count == 0) {
+      store_inflight = false;
+      wreq.push(std::make_pair(schedule(store_addr - store_size, true), store_id));
+      inflight++;
+      assert(w_last);
+    }
+  }
+
+  if (b_fire)
+    bresp.pop();
+
+  if (r_fire)
+    r_advance(rresp);
+
+  while (!rreq.empty() && rreq.front().first <= cycle) {
+    rresp.push(rreq.front().second);
+    rreq.pop();
+    inflight--;
+  }
+  while (!wreq.empty() && wreq.front().first <= cycle) {
+    bresp.push(wreq.front().second);
+    wreq.pop();
+    inflight--;
+  }
+
+  cycle++;
+
+  if (reset) {
+    while (!bresp.empty()) bresp.pop();
+    while (!rresp.empty()) rresp.pop();
+    while (!rreq.empty()) rreq.pop();
+    while (!wreq.empty()) wreq.pop();
+    store_inflight = false;
+    inflight = 0;
+    cycle = 0;
+    reset_timing();
+  }
+}
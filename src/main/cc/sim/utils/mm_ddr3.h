@@ -0,0 +1,143 @@
+// See LICENSE for license details.
+
+#ifndef _MM_EMULATOR_DDR3_H
+#define _MM_EMULATOR_DDR3_H
+
+#include "mm.h"
+#include <queue>
+#include <string>
+#include <utility>
+#include <vector>
+#include <stdint.h>
+
+// DDR3 parameters in DRAM clock cycles, read from the same ini files as
+// DRAMSim2 so both models describe the same part
+struct mm_ddr3_config_t
+{
+  size_t banks;
+  size_t rows;
+  size_t cols;
+  size_t device_width;
+  size_t bus_bits;
+  size_t queue_depth;
+  bool open_page;
+
+  uint64_t CL;
+  uint64_t AL;
+  uint64_t BL;
+  uint64_t tRAS;
+  uint64_t tRCD;
+  uint64_t tRRD;
+  uint64_t tRC;
+  uint64_t tRP;
+  uint64_t tCCD;
+  uint64_t tRTP;
+  uint64_t tWTR;
+  uint64_t tWR;
+  uint64_t tRFC;
+  uint64_t tREFI;
+
+  mm_ddr3_config_t();
+  // Missing files or keys leave the defaults, which match the shipped part
+  void load(const std::string& device_ini, const std::string& system_ini);
+};
+
+// Analytical DDR3 timing: each transaction is scheduled in order when it
+// is accepted, against per-bank row buffer state and a shared data bus,
+// so a tick is a few compares instead of a DRAMSim2 update().
+// One transaction per AXI burst, as in mm_dramsim2_t.
+class mm_ddr3_t : public mm_t
+{
+ public:
+  mm_ddr3_t() : store_inflight(false), inflight(0), cycle(0) {}
+
+  virtual void init(size_t sz, int word_size, int line_size);
+
+  virtual bool ar_ready() { return inflight < config.queue_depth; }
+  virtual bool aw_ready() { return inflight < config.queue_depth && !store_inflight; }
+  virtual bool w_ready() { return store_inflight; }
+  virtual bool b_valid() { return !bresp.empty(); }
+  virtual uint64_t b_resp() { return 0; }
+  virtual uint64_t b_id() { return b_valid() ? bresp.front() : 0; }
+  virtual bool r_valid() { return !rresp.empty(); }
+  virtual uint64_t r_resp() { return 0; }
+  virtual uint64_t r_id() { return r_valid() ? rresp.front().id: 0; }
+  virtual void *r_data() { return r_valid() ? r_beat(rresp.front()) : &dummy_data[0]; }
+  virtual bool r_last() { return r_valid() ? rresp.front().beats == 1 : false; }
+
+  // Up to the next transaction completing, or lockstep while a store
+  // takes beats or responses wait
+  virtual uint64_t run_ahead();
+  virtual void idle(uint64_t cycles) { cycle += cycles; }
+
+  virtual void tick
+  (
+    bool reset,
+
+    bool ar_valid,
+    uint64_t ar_addr,
+    uint64_t ar_id,
+    uint64_t ar_size,
+    uint64_t ar_len,
+
+    bool aw_valid,
+    uint64_t aw_addr,
+    uint64_t aw_id,
+    uint64_t aw_size,
+    uint64_t aw_len,
+
+    bool w_valid,
+    uint64_t w_strb,
+    void *w_data,
+    bool w_last,
+
+    bool r_ready,
+    bool b_ready
+  );
+
+  const mm_ddr3_config_t& get_config() const { return config; }
+  uint64_t get_row_hits() const { return row_hits; }
+  uint64_t get_row_misses() const { return row_misses; }
+
+ protected:
+  struct bank_t {
+    bool open;
+    uint64_t row;
+    uint64_t next_act;  // tRP, tRC
+    uint64_t next_pre;  // tRAS, tRTP, tWR
+    uint64_t next_cas;  // tRCD, tCCD
+  };
+
+  mm_ddr3_config_t config;
+  std::vector<bank_t> bank_state;
+  size_t ranks;
+  uint64_t bus_free;
+  uint64_t next_act;    // tRRD across banks
+  uint64_t next_read;   // tWTR after the last write burst
+  uint64_t next_refresh;
+  uint64_t row_hits;
+  uint64_t row_misses;
+
+  bool store_inflight;
+  uint64_t store_addr;
+  uint64_t store_id;
+  uint64_t store_size;
+  uint64_t store_count;
+  std::vector<char> dummy_data;
+
+  // Completion cycle of each accepted transaction, in completion order
+  size_t inflight;
+  std::queue<std::pair<uint64_t, mm_rresp_t> > rreq;
+  std::queue<std::pair<uint64_t, uint64_t> > wreq;
+  std::queue<mm_rresp_t> rresp;
+  std::queue<uint64_t> bresp;
+
+  uint64_t cycle;
+
+  void reset_timing();
+  void refresh(uint64_t until);
+  // Returns the cycle the data burst of a transaction at addr finishes
+  uint64_t schedule(uint64_t addr, bool write);
+};
+
+#endif
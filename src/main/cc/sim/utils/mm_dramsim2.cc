@@ -1,6 +1,7 @@
 // See LICENSE for license details.
 
 #include "mm_dramsim2.h"
+#include "mm_profile.h"
 #include "mm.h"
 #include <iostream>
 #include <fstream>
@@ -16,12 +17,9 @@ using namespace DRAMSim;
 
 void mm_dramsim2_t::read_complete(unsigned id, uint64_t address, uint64_t clock_cycle)
 {
-  mm_rresp_t resp;
-  do {
-    resp = rreq[address].front();
-    rresp.push(resp);
-    rreq[address].pop();
-  } while (!resp.last);
+  rresp.push(rreq[address].front());
+  rreq[address].pop();
+  outstanding--;
 }
 
 void mm_dramsim2_t::write_complete(unsigned id, uint64_t address, uint64_t clock_cycle)
@@ -29,6 +27,7 @@ void mm_dramsim2_t::write_complete(unsigned id, uint64_t address, uint64_t clock
   auto b_id = wreq[address].front();
   bresp.push(b_id);
   wreq[address].pop();
+  outstanding--;
 }
 
 void power_callback(double a, double b, double c, double d)
@@ -36,6 +35,13 @@ void power_callback(double a, double b, double c, double d)
     //fprintf(stderr, "power callback: %0.3f, %0.3f, %0.3f, %0.3f\n",a,b,c,d);
 }
 
+void mm_dramsim2_t::parse_args(const std::vector<std::string>& args)
+{
+  for (auto &arg: args) {
+    if (arg.find("+dramsim-idle-skip") == 0) idle_skip = true;
+  }
+}
+
 void mm_dramsim2_t::init(size_t sz, int wsz, int lsz)
 {
   assert(lsz == 64); // assumed by dramsim2
@@ -55,11 +61,38 @@ void mm_dramsim2_t::init(size_t sz, int wsz, int lsz)
   TransactionCompleteCB *write_cb = new Callback<mm_dramsim2_t, void, unsigned, uint64_t, uint64_t>(this, &mm_dramsim2_t::write_complete);
   mem->RegisterCallbacks(read_cb, write_cb, power_callback);
 
+  mm_ddr3_config_t config;
+  config.load(pwd + "/DDR3_micron_64M_8B_x4_sg15.ini", pwd + "/system.ini");
+  refresh_period = config.tREFI;
+  // Every rank refreshes once within a period of going idle
+  settle_cycles = config.tREFI + config.tRFC;
+
 #ifdef DEBUG_DRAMSIM2
   fprintf(stderr,"Dramsim2 init successful\n");
 #endif
 }
 
+void mm_dramsim2_t::update()
+{
+  if (outstanding || !idle_skip) {
+    mem->update();
+    return;
+  }
+  if (++idle_cycles <= settle_cycles) {
+    mem->update();
+  } else if (++lag == refresh_period) {
+    skipped += refresh_period;
+    lag = 0;
+  }
+}
+
+void mm_dramsim2_t::wake()
+{
+  for (uint64_t i = 0 ; i < lag ; i++) mem->update();
+  lag = 0;
+  idle_cycles = 0;
+}
+
 void mm_dramsim2_t::tick(
   bool reset,
 
@@ -90,15 +123,16 @@ void mm_dramsim2_t::tick(
   bool b_fire = !reset && b_valid() && b_ready;
 
   if (ar_fire) {
+    MM_PROFILE_ACCESS(cycle, ar_addr % size, (ar_len + 1) << ar_size, ar_id, false);
     uint64_t start_addr = (ar_addr / word_size) * word_size;
-    for (size_t i = 0; i <= ar_len; i++) {
-      auto dat = read(start_addr + i * word_size);
-      rreq[ar_addr].push(mm_rresp_t(ar_id, dat, (i == ar_len)));
-    }
+    rreq[ar_addr].push(mm_rresp_t(ar_id, start_addr % size, ar_len + 1));
+    wake();
     mem->addTransaction(false, ar_addr);
+    outstanding++;
   }
 
   if (aw_fire) {
+    MM_PROFILE_ACCESS(cycle, aw_addr % size, (aw_len + 1) << aw_size, aw_id, true);
     store_addr = aw_addr;
     store_id = aw_id;
     store_count = aw_len + 1;
@@ -113,7 +147,9 @@ void mm_dramsim2_t::tick(
 
     if (store_count == 0) {
       store_inflight = false;
+      wake();
       mem->addTransaction(true, store_addr);
+      outstanding++;
       wreq[store_addr].push(store_id);
       assert(w_last);
     }
@@ -123,9 +159,9 @@ void mm_dramsim2_t::tick(
     bresp.pop();
 
   if (r_fire)
-    rresp.pop();
+    r_advance(rresp);
 
-  mem->update();
+  update();
   cycle++;
 
   if (reset) {
@@ -4,6 +4,7 @@
 #define _MM_EMULATOR_DRAMSIM2_H
 
 #include "mm.h"
+#include "mm_ddr3.h"
 #include "MultiChannelMemorySystem.h" // DRAMSim
 #include <map>
 #include <queue>
@@ -12,9 +13,11 @@
 class mm_dramsim2_t : public mm_t
 {
  public:
-  mm_dramsim2_t() : store_inflight(false) {}
+  mm_dramsim2_t() : cycle(0), store_inflight(false), outstanding(0),
+    idle_skip(false), idle_cycles(0), lag(0), skipped(0) {}
 
   virtual void init(size_t sz, int word_size, int line_size);
+  virtual void parse_args(const std::vector<std::string>& args);
 
   virtual bool ar_ready() { return mem->willAcceptTransaction(); }
   virtual bool aw_ready() { return mem->willAcceptTransaction() && !store_inflight; }
@@ -25,8 +28,8 @@ class mm_dramsim2_t : public mm_t
   virtual bool r_valid() { return !rresp.empty(); }
   virtual uint64_t r_resp() { return 0; }
   virtual uint64_t r_id() { return r_valid() ? rresp.front().id: 0; }
-  virtual void *r_data() { return r_valid() ? &rresp.front().data[0] : &dummy_data[0]; }
-  virtual bool r_last() { return r_valid() ? rresp.front().last : false; }
+  virtual void *r_data() { return r_valid() ? r_beat(rresp.front()) : &dummy_data[0]; }
+  virtual bool r_last() { return r_valid() ? rresp.front().beats == 1 : false; }
 
   virtual void tick
   (
@@ -53,6 +56,10 @@ class mm_dramsim2_t : public mm_t
     bool b_ready
   );
 
+  // Idle fast-forward is off unless +dramsim-idle-skip is given
+  void set_idle_skip(bool skip) { idle_skip = skip; }
+  // DRAM cycles not simulated because the memory was idle
+  uint64_t get_skipped_cycles() const { return skipped; }
 
  protected:
   DRAMSim::MultiChannelMemorySystem *mem;
@@ -70,6 +77,23 @@ class mm_dramsim2_t : public mm_t
   std::map<uint64_t, std::queue<mm_rresp_t> > rreq;
   std::queue<mm_rresp_t> rresp;
 
+  // Idle fast-forward. Once nothing has been outstanding for long enough
+  // that every rank has refreshed, DRAMSim2's state is assumed to repeat
+  // every refresh period, so whole periods of updates can be dropped.
+  // Skipped cycles short of a whole period are replayed before the next
+  // request, which keeps refresh at the same points relative to the target.
+  // The assumption has yet to be checked against DRAMSim2 itself, whose
+  // ranks refresh on staggered countdowns, hence the opt-in.
+  size_t outstanding;
+  bool idle_skip;
+  uint64_t refresh_period;
+  uint64_t settle_cycles;
+  uint64_t idle_cycles;
+  uint64_t lag;
+  uint64_t skipped;
+  void update();
+  void wake();
+
   void read_complete(unsigned id, uint64_t address, uint64_t clock_cycle);
   void write_complete(unsigned id, uint64_t address, uint64_t clock_cycle);
 };
@@ -0,0 +1,253 @@
+// See LICENSE for license details.
+
+#include "mm_latency_pipe.h"
+#include "mm_profile.h"
+#include <algorithm>
+#include <cassert>
+
+mm_latency_pipe_t::mm_latency_pipe_t():
+  // Reset values of the widget's registers
+  mem_latency(32), llc_latency(8), llc(false),
+  way_bits(2), set_bits(10), block_bits(6),
+  store_inflight(false), read_entries(0), cycle(0) {}
+
+void mm_latency_pipe_t::parse_args(const std::vector<std::string>& args)
+{
+  for (auto &arg: args) {
+    if (arg.find("+mm_") != 0) continue;
+    const std::string sub_arg = arg.substr(4);
+    const size_t delimit_idx = sub_arg.find_first_of("=");
+    const std::string key = sub_arg.substr(0, delimit_idx);
+    const uint64_t value = std::stoi(sub_arg.substr(delimit_idx + 1));
+    if (key == "MEM_LATENCY") {
+      mem_latency = value;
+    } else if (key == "LLC_LATENCY") {
+      llc_latency = value;
+      llc = true;
+    } else if (key == "LLC_WAY_BITS") {
+      way_bits = value;
+      llc = true;
+    } else if (key == "LLC_SET_BITS") {
+      set_bits = value;
+      llc = true;
+    } else if (key == "LLC_BLOCK_BITS") {
+      block_bits = value;
+      llc = true;
+    }
+  }
+  reset_state();
+}
+
+void mm_latency_pipe_t::init(size_t sz, int wsz, int lsz)
+{
+  mm_t::init(sz, wsz, lsz);
+  dummy_data.resize(word_size);
+  reset_state();
+}
+
+void mm_latency_pipe_t::reset_state()
+{
+  const size_t entries = llc ? (size_t)1 << (way_bits + set_bits) : 0;
+  tags.assign(entries, 0);
+  valid.assign(entries, false);
+  dirty.assign(entries, false);
+  lfsr = 1;
+  llc_free = 0;
+  // Rows start out all ones
+  rows.assign(1 << MM_PIPE_BANK_NUM_BITS, (1ULL << MM_PIPE_ROW_NUM_BITS) - 1);
+  reads = writes = misses = 0;
+  same_row_reads = diff_row_reads = same_row_writes = diff_row_writes = 0;
+}
+
+void mm_latency_pipe_t::count_row(uint64_t addr, bool write)
+{
+  const uint64_t bank = (addr >> MM_PIPE_BANK_BIT_OFFSET) &
+                        ((1 << MM_PIPE_BANK_NUM_BITS) - 1);
+  const uint64_t row = (addr >> MM_PIPE_ROW_BIT_OFFSET) &
+                       ((1ULL << MM_PIPE_ROW_NUM_BITS) - 1);
+  const bool same = rows[bank] == row;
+  rows[bank] = row;
+  if (write) {
+    (same ? same_row_writes : diff_row_writes)++;
+  } else {
+    (same ? same_row_reads : diff_row_reads)++;
+  }
+}
+
+bool mm_latency_pipe_t::lookup(uint64_t addr, bool write, bool fill)
+{
+  const size_t ways = (size_t)1 << way_bits;
+  const uint64_t set = (addr >> block_bits) & ((1ULL << set_bits) - 1);
+  const uint64_t tag = addr >> (block_bits + set_bits);
+  const size_t base = set * ways;
+  for (size_t way = 0 ; way < ways ; way++) {
+    if (valid[base + way] && tags[base + way] == tag) return true;
+  }
+
+  misses++;
+  bool wb = false;
+  if (fill) {
+    size_t way = 0;
+    while (way < ways && valid[base + way]) way++;
+    if (way == ways) {
+      // LFSR16 of chisel3.util, stepped on every replacement
+      way = lfsr & (ways - 1);
+      wb = dirty[base + way];
+      lfsr = (((lfsr ^ (lfsr >> 2) ^ (lfsr >> 3) ^ (lfsr >> 5)) & 1) << 15) | (lfsr >> 1);
+    }
+    valid[base + way] = true;
+    // Dirty bits are only ever set, as in the widget
+    dirty[base + way] = dirty[base + way] || write;
+    tags[base + way] = tag;
+  }
+  // The widget tells reads from writes by the write-back of the victim
+  count_row(addr, wb);
+  return false;
+}
+
+// A response is returned by the tick after which its ready cycle has
+// come, and ticks with no requests change nothing else
+uint64_t mm_latency_pipe_t::run_ahead()
+{
+  if (store_inflight || (rreq.empty() && wreq.empty())) return 1;
+  uint64_t due = UINT64_MAX;
+  if (!rreq.empty()) due = std::min(due, rreq.front().ready);
+  if (!wreq.empty()) due = std::min(due, wreq.front().ready);
+  return due > cycle ? due - cycle : 1;
+}
+
+void mm_latency_pipe_t::tick(
+  bool reset,
+
+  bool ar_valid,
+  uint64_t ar_addr,
+  uint64_t ar_id,
+  uint64_t ar_size,
+  uint64_t ar_len,
+
+  bool aw_valid,
+  uint64_t aw_addr,
+  uint64_t aw_id,
+  uint64_t aw_size,
+  uint64_t aw_len,
+
+  bool w_valid,
+  uint64_t w_strb,
+  void *w_data,
+  bool w_last,
+
+  bool r_ready,
+  bool b_ready)
+{
+  bool ar_fire = !reset && ar_valid && ar_ready();
+  bool aw_fire = !reset && aw_valid && aw_ready();
+  bool w_fire = !reset && w_valid && w_ready();
+  bool r_fire = !reset && r_valid() && r_ready;
+  bool b_fire = !reset && b_valid() && b_ready;
+
+  if (ar_fire) {
+    MM_PROFILE_ACCESS(cycle, ar_addr % size, (ar_len + 1) << ar_size, ar_id, false);
+    uint64_t start_addr = (ar_addr / word_size) * word_size;
+    read_t r;
+    r.burst = mm_rresp_t(ar_id, start_addr % size, ar_len + 1);
+    if (llc) {
+      // Every beat is looked up, and the line is only filled after the
+      // last one, so the beats of a burst all hit or all miss
+      const uint64_t start = std::max(cycle + 1, llc_free);
+      bool hit = true;
+      for (uint64_t i = 0 ; i <= ar_len ; i++) {
+        hit = lookup(ar_addr, false, i == ar_len);
+      }
+      reads += ar_len + 1;
+      // The response leaves two cycles into a lookup
+      r.ready = start + 2 + (hit ? llc_latency : mem_latency);
+      r.step = 3;
+      llc_free = start + 3 * (ar_len + 1);
+    } else {
+      reads++;
+      count_row(ar_addr, false);
+      misses++;
+      r.ready = cycle + mem_latency;
+      r.step = 0;
+    }
+    rreq.push_back(r);
+    read_entries += llc ? ar_len + 1 : 1;
+  }
+
+  if (aw_fire) {
+    MM_PROFILE_ACCESS(cycle, aw_addr % size, (aw_len + 1) << aw_size, aw_id, true);
+    store_addr = aw_addr;
+    store_start = aw_addr;
+    store_id = aw_id;
+    store_count = aw_len + 1;
+    store_size = 1 << aw_size;
+    store_inflight = true;
+    if (!llc) {
+      writes++;
+      count_row(aw_addr, true);
+      misses++;
+    }
+  }
+
+  if (w_fire) {
+    write(store_addr, (uint8_t*)w_data, w_strb, store_size);
+    store_addr += store_size;
+    store_count--;
+
+    if (store_count == 0) {
+      store_inflight = false;
+      write_t w;
+      w.id = store_id;
+      if (llc) {
+        const uint64_t start = std::max(cycle + 1, llc_free);
+        const bool hit = lookup(store_start, true, true);
+        writes++;
+        w.ready = start + 2 + (hit ? llc_latency : mem_latency);
+        llc_free = start + 3;
+      } else {
+        w.ready = cycle + mem_latency;
+      }
+      wreq.push_back(w);
+      assert(w_last);
+    }
+  }
+
+  if (b_fire)
+    wreq.pop_front();
+
+  if (r_fire) {
+    read_t& r = rreq.front();
+    if (llc) read_entries--;
+    if (--r.burst.beats == 0) {
+      if (!llc) read_entries--;
+      rreq.pop_front();
+    } else {
+      r.burst.addr = (r.burst.addr + word_size) % size;
+      r.ready += r.step;
+    }
+  }
+
+  cycle++;
+
+  if (reset) {
+    rreq.clear();
+    wreq.clear();
+    read_entries = 0;
+    store_inflight = false;
+    cycle = 0;
+    reset_state();
+  }
+}
+
+void mm_latency_pipe_t::print_stats(FILE* file) const
+{
+  mm_t::print_stats(file);
+  fprintf(file, "Memory Model Stats\n");
+  fprintf(file, " - LLC reads: %llu\n", (unsigned long long)reads);
+  fprintf(file, " - LLC writes: %llu\n", (unsigned long long)writes);
+  fprintf(file, " - Misses: %llu\n", (unsigned long long)misses);
+  fprintf(file, " - Same row reads: %llu\n", (unsigned long long)same_row_reads);
+  fprintf(file, " - Diff row reads: %llu\n", (unsigned long long)diff_row_reads);
+  fprintf(file, " - Same row writes: %llu\n", (unsigned long long)same_row_writes);
+  fprintf(file, " - Diff row writes: %llu\n", (unsigned long long)diff_row_writes);
+}
@@ -0,0 +1,138 @@
+// See LICENSE for license details.
+
+#ifndef _MM_EMULATOR_LATENCY_PIPE_H
+#define _MM_EMULATOR_LATENCY_PIPE_H
+
+#include "mm.h"
+#include <deque>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+// DRAM row tracking of SimpleLatencyPipe, as set in Config.scala
+#define MM_PIPE_BANK_NUM_BITS 3
+#define MM_PIPE_BANK_BIT_OFFSET 0
+#define MM_PIPE_ROW_NUM_BITS 14
+#define MM_PIPE_ROW_BIT_OFFSET 11
+
+// The timing of the SimpleLatencyPipe widget on the host, configured by the
+// same +mm_<register>=<value> arguments FpgaMemoryModel writes to it:
+//  - MEM_LATENCY: cycles from a read request or the last write beat to
+//    the response
+//  - LLC_LATENCY, LLC_WAY_BITS, LLC_SET_BITS, LLC_BLOCK_BITS: any of them
+//    puts the LLC model in front, as a build with LLCModelKey does. Each
+//    lookup takes three cycles, one per beat of a read, and a hit answers
+//    after LLC_LATENCY instead.
+// Lookups are scheduled in the order requests are accepted, where the
+// widget lets a pending write go first.
+class mm_latency_pipe_t : public mm_t
+{
+ public:
+  mm_latency_pipe_t();
+
+  virtual void init(size_t sz, int word_size, int line_size);
+  virtual void parse_args(const std::vector<std::string>& args);
+
+  virtual bool ar_ready() { return read_entries < MM_PIPE_READS; }
+  virtual bool aw_ready() { return wreq.size() < MM_PIPE_WRITES && !store_inflight; }
+  virtual bool w_ready() { return store_inflight; }
+  virtual bool b_valid() { return !wreq.empty() && wreq.front().ready <= cycle; }
+  virtual uint64_t b_resp() { return 0; }
+  virtual uint64_t b_id() { return b_valid() ? wreq.front().id : 0; }
+  virtual bool r_valid() { return !rreq.empty() && rreq.front().ready <= cycle; }
+  virtual uint64_t r_resp() { return 0; }
+  virtual uint64_t r_id() { return r_valid() ? rreq.front().burst.id : 0; }
+  virtual void *r_data() { return r_valid() ? r_beat(rreq.front().burst) : &dummy_data[0]; }
+  virtual bool r_last() { return r_valid() ? rreq.front().burst.beats == 1 : false; }
+
+  // Up to the next response due, or lockstep while a store takes beats
+  virtual uint64_t run_ahead();
+  virtual void idle(uint64_t cycles) { cycle += cycles; }
+
+  virtual void tick
+  (
+    bool reset,
+
+    bool ar_valid,
+    uint64_t ar_addr,
+    uint64_t ar_id,
+    uint64_t ar_size,
+    uint64_t ar_len,
+
+    bool aw_valid,
+    uint64_t aw_addr,
+    uint64_t aw_id,
+    uint64_t aw_size,
+    uint64_t aw_len,
+
+    bool w_valid,
+    uint64_t w_strb,
+    void *w_data,
+    bool w_last,
+
+    bool r_ready,
+    bool b_ready
+  );
+
+  // Prints the counters FpgaMemoryModel::finish reads from the widget
+  virtual void print_stats(FILE* file) const;
+
+ protected:
+  // Depths of the widget's rCycles and wCycles queues
+  static const size_t MM_PIPE_READS = 64;
+  static const size_t MM_PIPE_WRITES = 8;
+
+  struct read_t {
+    uint64_t ready; // cycle the current beat can be returned
+    uint64_t step;  // cycles between beats
+    mm_rresp_t burst;
+  };
+  struct write_t {
+    uint64_t ready;
+    uint64_t id;
+  };
+
+  uint64_t mem_latency;
+  uint64_t llc_latency;
+  bool llc;
+  size_t way_bits;
+  size_t set_bits;
+  size_t block_bits;
+
+  // LLC tag state, one entry per set and way
+  std::vector<uint64_t> tags;
+  std::vector<bool> valid;
+  std::vector<bool> dirty;
+  uint16_t lfsr;
+  uint64_t llc_free; // first cycle the LLC can start a lookup
+
+  std::vector<uint64_t> rows; // open row per bank
+
+  uint64_t reads, writes, misses;
+  uint64_t same_row_reads, diff_row_reads;
+  uint64_t same_row_writes, diff_row_writes;
+
+  bool store_inflight;
+  uint64_t store_addr;
+  uint64_t store_id;
+  uint64_t store_size;
+  uint64_t store_count;
+  uint64_t store_start;
+  std::vector<char> dummy_data;
+
+  std::deque<read_t> rreq;
+  std::deque<write_t> wreq;
+  // Timing entries in flight: the widget queues one per burst, or one per
+  // beat behind the LLC
+  size_t read_entries;
+
+  uint64_t cycle;
+
+  void reset_state();
+  // Looks addr up in the LLC, filling its line on a miss if fill, and
+  // returns whether it hit
+  bool lookup(uint64_t addr, bool write, bool fill);
+  void count_row(uint64_t addr, bool write);
+};
+
+#endif
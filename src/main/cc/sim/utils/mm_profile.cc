@@ -0,0 +1,181 @@
+// See LICENSE for license details.
+
+#include "mm_profile.h"
+#include "mm.h"
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+#define MM_PROFILE_EXIT (~0U)
+// Hottest regions listed in the summary
+#define MM_PROFILE_TOP_REGIONS 8
+
+mm_profile_t::mm_profile_t(const std::string& prefix, uint64_t region_size, uint64_t interval):
+    prefix(prefix), region_size(std::max<uint64_t>(region_size, 1)),
+    interval(std::max<uint64_t>(interval, 1)), cur(0), fill(0), full(), free_chunks(),
+    reads(0), writes(0), read_bytes(0), write_bytes(0), last_cycle(0) {
+  file = fopen((prefix + ".bin").c_str(), "wb");
+  if (!file) {
+    fprintf(stderr, "Cannot open %s.bin\n", prefix.c_str());
+    exit(EXIT_FAILURE);
+  }
+  for (uint32_t i = 0 ; i < MM_PROFILE_CHUNKS ; i++) {
+    chunks[i].resize(MM_PROFILE_CHUNK);
+    counts[i] = 0;
+    if (i != cur) free_chunks.push(&i, 1);
+  }
+  if (pthread_create(&thread, NULL, flush_main, this)) {
+    fprintf(stderr, "Cannot start the memory profile thread\n");
+    abort();
+  }
+}
+
+// The rings are cache-line aligned, which plain new doesn't honor in C++11
+void* mm_profile_t::operator new(size_t size) {
+  void* p;
+  if (posix_memalign(&p, 64, size)) throw std::bad_alloc();
+  return p;
+}
+
+void mm_profile_t::operator delete(void* p) {
+  free(p);
+}
+
+mm_profile_t::~mm_profile_t() {
+  if (fill) {
+    counts[cur] = fill;
+    full.push(&cur, 1);
+  }
+  const uint32_t exit = MM_PROFILE_EXIT;
+  full.push(&exit, 1);
+  pthread_join(thread, NULL);
+  fclose(file);
+  write_summaries();
+}
+
+// Waits for a free chunk only when the flush thread is a whole ring behind
+void mm_profile_t::swap() {
+  counts[cur] = fill;
+  full.push(&cur, 1);
+  free_chunks.wait([this](){ return !free_chunks.empty(); });
+  free_chunks.pop(&cur, 1);
+  fill = 0;
+}
+
+void* mm_profile_t::flush_main(void* arg) {
+  mm_profile_t* p = (mm_profile_t*)arg;
+  while (true) {
+    uint32_t idx = MM_PROFILE_EXIT;
+    p->full.wait([p](){ return !p->full.empty(); });
+    p->full.pop(&idx, 1);
+    if (idx == MM_PROFILE_EXIT) break;
+    const mm_access_t* recs = &p->chunks[idx][0];
+    if (fwrite(recs, sizeof(mm_access_t), p->counts[idx], p->file) != p->counts[idx]) {
+      perror((p->prefix + ".bin").c_str());
+    }
+    p->account(recs, p->counts[idx]);
+    p->free_chunks.push(&idx, 1);
+  }
+  return NULL;
+}
+
+void mm_profile_t::account(const mm_access_t* recs, size_t n) {
+  for (size_t i = 0 ; i < n ; i++) {
+    const mm_access_t& a = recs[i];
+    const uint64_t r = a.addr / region_size;
+    const uint64_t t = a.cycle / interval;
+    if (r >= regions.size()) regions.resize(r + 1, mm_region_stat_t());
+    if (t >= bandwidth.size()) bandwidth.resize(t + 1);
+    mm_region_stat_t& s = regions[r];
+    if (a.write) {
+      s.writes++;
+      s.write_bytes += a.len;
+      bandwidth[t].second += a.len;
+      writes++;
+      write_bytes += a.len;
+    } else {
+      s.reads++;
+      s.read_bytes += a.len;
+      bandwidth[t].first += a.len;
+      reads++;
+      read_bytes += a.len;
+    }
+    last_cycle = std::max(last_cycle, a.cycle);
+  }
+}
+
+void mm_profile_t::write_summaries() {
+  FILE* heatmap = fopen((prefix + "-heatmap.csv").c_str(), "w");
+  if (heatmap) {
+    fprintf(heatmap, "addr,reads,writes,read_bytes,write_bytes\n");
+    for (size_t r = 0 ; r < regions.size() ; r++) {
+      const mm_region_stat_t& s = regions[r];
+      if (!s.reads && !s.writes) continue;
+      fprintf(heatmap, "0x%llx,%llu,%llu,%llu,%llu\n",
+        (unsigned long long)(r * region_size),
+        (unsigned long long)s.reads, (unsigned long long)s.writes,
+        (unsigned long long)s.read_bytes, (unsigned long long)s.write_bytes);
+    }
+    fclose(heatmap);
+  }
+  FILE* bw = fopen((prefix + "-bandwidth.csv").c_str(), "w");
+  uint64_t peak = 0;
+  if (bw) {
+    fprintf(bw, "cycle,read_bytes,write_bytes\n");
+    for (size_t t = 0 ; t < bandwidth.size() ; t++) {
+      fprintf(bw, "%llu,%llu,%llu\n", (unsigned long long)(t * interval),
+        (unsigned long long)bandwidth[t].first, (unsigned long long)bandwidth[t].second);
+      peak = std::max(peak, bandwidth[t].first + bandwidth[t].second);
+    }
+    fclose(bw);
+  }
+
+  fprintf(stderr, "Memory profile %s: %llu reads (%llu B), %llu writes (%llu B) in %llu cycles\n",
+    prefix.c_str(), (unsigned long long)reads, (unsigned long long)read_bytes,
+    (unsigned long long)writes, (unsigned long long)write_bytes,
+    (unsigned long long)last_cycle + 1);
+  fprintf(stderr, "  mean %.3f B/cycle, peak %.3f B/cycle over %llu cycles\n",
+    (double)(read_bytes + write_bytes) / (last_cycle + 1), (double)peak / interval,
+    (unsigned long long)interval);
+  std::vector<size_t> hot;
+  for (size_t r = 0 ; r < regions.size() ; r++) {
+    if (regions[r].reads || regions[r].writes) hot.push_back(r);
+  }
+  auto bytes = [this](size_t r) { return regions[r].read_bytes + regions[r].write_bytes; };
+  const size_t top = std::min<size_t>(hot.size(), MM_PROFILE_TOP_REGIONS);
+  std::partial_sort(hot.begin(), hot.begin() + top, hot.end(),
+    [&](size_t a, size_t b) { return bytes(a) > bytes(b); });
+  for (size_t i = 0 ; i < top ; i++) {
+    const mm_region_stat_t& s = regions[hot[i]];
+    fprintf(stderr, "  0x%010llx: %llu reads, %llu writes, %llu B\n",
+      (unsigned long long)(hot[i] * region_size),
+      (unsigned long long)s.reads, (unsigned long long)s.writes,
+      (unsigned long long)bytes(hot[i]));
+  }
+}
+
+void mm_profile_init(mm_base_t* mem, const std::vector<std::string>& args,
+                     const std::string& suffix) {
+  std::string prefix;
+  for (auto &arg: args) {
+    if (arg.find("+mm-profile=") == 0) {
+      prefix = arg.substr(12);
+    }
+  }
+  if (prefix.empty()) return;
+#ifdef ENABLE_MM_PROFILE
+  uint64_t region_size = 1 << 20;
+  uint64_t interval = 1 << 16;
+  for (auto &arg: args) {
+    if (arg.find("+mm-profile-region=") == 0) {
+      region_size = strtoull(arg.c_str() + 19, NULL, 10);
+    }
+    if (arg.find("+mm-profile-interval=") == 0) {
+      interval = strtoull(arg.c_str() + 21, NULL, 10);
+    }
+  }
+  mem->set_profile(new mm_profile_t(prefix + suffix, region_size, interval));
+#else
+  fprintf(stderr, "+mm-profile needs a build with MM_PROFILE=1, ignoring it\n");
+#endif
+}
@@ -0,0 +1,107 @@
+// See LICENSE for license details.
+
+#ifndef __MM_PROFILE_H
+#define __MM_PROFILE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <string>
+#include <vector>
+#include "spsc_ring.h"
+
+// Target memory accesses seen by the host memory models, built with
+// -DENABLE_MM_PROFILE and turned on with +mm-profile=<prefix>.
+// A model appends one record per AXI burst to a chunk; full chunks go to a
+// background thread that writes them to <prefix>.bin and accumulates the
+// per-region heatmap (<prefix>-heatmap.csv) and the requested bandwidth
+// by the cycle bursts are accepted (<prefix>-bandwidth.csv), both written
+// when the profile is closed.
+// Without the flag MM_PROFILE_ACCESS expands to nothing.
+
+// One record of <prefix>.bin, in host byte order
+struct mm_access_t {
+  uint64_t cycle;
+  uint64_t addr;  // modulo the memory size, as the model stores it
+  uint32_t len;   // bytes in the burst
+  uint16_t id;
+  uint8_t write;
+  uint8_t pad;
+};
+
+// Records per chunk, and chunks in flight to the flush thread
+#define MM_PROFILE_CHUNK (1 << 16)
+#define MM_PROFILE_CHUNKS 8
+
+struct mm_region_stat_t {
+  uint64_t reads;
+  uint64_t writes;
+  uint64_t read_bytes;
+  uint64_t write_bytes;
+};
+
+class mm_profile_t
+{
+public:
+  // region_size bytes per heatmap row, interval cycles per bandwidth row
+  mm_profile_t(const std::string& prefix, uint64_t region_size, uint64_t interval);
+  // Drains the chunks and writes the summaries
+  ~mm_profile_t();
+  static void* operator new(size_t size);
+  static void operator delete(void* p);
+
+  inline void record(uint64_t cycle, uint64_t addr, uint64_t len, uint64_t id, bool write) {
+    if (fill == MM_PROFILE_CHUNK) swap();
+    mm_access_t& a = chunks[cur][fill++];
+    a.cycle = cycle;
+    a.addr = addr;
+    a.len = len;
+    a.id = id;
+    a.write = write;
+    a.pad = 0;
+  }
+
+private:
+  const std::string prefix;
+  const uint64_t region_size;
+  const uint64_t interval;
+  FILE* file;
+  pthread_t thread;
+
+  std::vector<mm_access_t> chunks[MM_PROFILE_CHUNKS];
+  size_t counts[MM_PROFILE_CHUNKS];
+  uint32_t cur;
+  size_t fill;
+  // Chunk indices: full ones to the flush thread and free ones back
+  spsc_ring_t<uint32_t, 2 * MM_PROFILE_CHUNKS> full;
+  spsc_ring_t<uint32_t, 2 * MM_PROFILE_CHUNKS> free_chunks;
+
+  // Owned by the flush thread until it exits
+  std::vector<mm_region_stat_t> regions;
+  std::vector<std::pair<uint64_t, uint64_t> > bandwidth; // read, write bytes
+  uint64_t reads, writes, read_bytes, write_bytes, last_cycle;
+
+  void swap();
+  void account(const mm_access_t* recs, size_t n);
+  void write_summaries();
+  static void* flush_main(void* arg);
+};
+
+class mm_base_t;
+
+// Attaches a profile to mem if args hold +mm-profile=<prefix>, with the
+// region (+mm-profile-region=<bytes>) and interval
+// (+mm-profile-interval=<cycles>) given; suffix tells the files of
+// several stores apart
+void mm_profile_init(mm_base_t* mem, const std::vector<std::string>& args,
+                     const std::string& suffix = "");
+
+#ifdef ENABLE_MM_PROFILE
+#define MM_PROFILE_ACCESS(cycle, addr, len, id, write) \
+  if (profile) profile->record(cycle, addr, len, id, write)
+#else
+#define MM_PROFILE_ACCESS(cycle, addr, len, id, write)
+#endif
+
+#endif // __MM_PROFILE_H
@@ -0,0 +1,91 @@
+// See LICENSE for license details.
+
+#include "mmio_profile.h"
+#include <cstring>
+
+mmio_profile_t mmio_profile;
+
+static const char* const phase_names[MMIO_PHASE_NUM] = {
+  "control", "serial", "uart", "sim_mem", "counters", "sampling", "loadmem", "fpga_model"
+};
+
+static const char* const kind_names[MMIO_KIND_NUM] = {
+  "read", "write", "pull", "push", "flush"
+};
+
+mmio_profile_t::mmio_profile_t(): phase(MMIO_PHASE_CONTROL) {
+  memset(stats, 0, sizeof(stats));
+}
+
+// Upper bound of the bucket holding the p-th percentile
+uint64_t mmio_profile_t::percentile(const mmio_stat_t& s, double p) const {
+  uint64_t rank = (uint64_t)(p * s.calls), seen = 0;
+  for (size_t i = 0 ; i < MMIO_PROFILE_BUCKETS ; i++) {
+    seen += s.hist[i];
+    if (seen > rank) return 2ULL << i;
+  }
+  return 2ULL << (MMIO_PROFILE_BUCKETS - 1);
+}
+
+void mmio_profile_t::print(FILE* file) const {
+  uint64_t total_ns = 0;
+  for (size_t p = 0 ; p < MMIO_PHASE_NUM ; p++) {
+    for (size_t k = 0 ; k < MMIO_KIND_NUM ; k++) {
+      total_ns += stats[p][k].ns;
+    }
+  }
+  fprintf(file, "MMIO profile (%.3f s in transport calls):\n", total_ns / 1e9);
+  fprintf(file, "%-10s %-5s %12s %12s %14s %10s %6s %10s %10s\n",
+    "phase", "kind", "calls", "ops", "bytes", "time (ms)", "%", "p50 (ns)", "p99 (ns)");
+  for (size_t p = 0 ; p < MMIO_PHASE_NUM ; p++) {
+    for (size_t k = 0 ; k < MMIO_KIND_NUM ; k++) {
+      const mmio_stat_t& s = stats[p][k];
+      if (!s.calls) continue;
+      fprintf(file, "%-10s %-5s %12llu %12llu %14llu %10.3f %6.2f %10llu %10llu\n",
+        phase_names[p], kind_names[k],
+        (unsigned long long)s.calls,
+        (unsigned long long)s.ops,
+        (unsigned long long)s.bytes,
+        s.ns / 1e6,
+        total_ns ? 100.0 * s.ns / total_ns : 0.0,
+        (unsigned long long)percentile(s, 0.5),
+        (unsigned long long)percentile(s, 0.99));
+    }
+  }
+}
+
+bool mmio_profile_t::dump_json(const char* filename) const {
+  FILE* file = fopen(filename, "w");
+  if (!file) {
+    fprintf(stderr, "Cannot open %s\n", filename);
+    return false;
+  }
+  fprintf(file, "{\n");
+  bool first_phase = true;
+  for (size_t p = 0 ; p < MMIO_PHASE_NUM ; p++) {
+    bool first_kind = true;
+    for (size_t k = 0 ; k < MMIO_KIND_NUM ; k++) {
+      const mmio_stat_t& s = stats[p][k];
+      if (!s.calls) continue;
+      if (first_kind) {
+        fprintf(file, "%s  \"%s\": {\n", first_phase ? "" : ",\n", phase_names[p]);
+        first_phase = false;
+      }
+      fprintf(file, "%s    \"%s\": {\"calls\": %llu, \"ops\": %llu, \"bytes\": %llu, \"ns\": %llu, \"hist\": [",
+        first_kind ? "" : ",\n", kind_names[k],
+        (unsigned long long)s.calls,
+        (unsigned long long)s.ops,
+        (unsigned long long)s.bytes,
+        (unsigned long long)s.ns);
+      for (size_t i = 0 ; i < MMIO_PROFILE_BUCKETS ; i++) {
+        fprintf(file, "%s%llu", i ? ", " : "", (unsigned long long)s.hist[i]);
+      }
+      fprintf(file, "]}");
+      first_kind = false;
+    }
+    if (!first_kind) fprintf(file, "\n  }");
+  }
+  fprintf(file, "\n}\n");
+  fclose(file);
+  return true;
+}
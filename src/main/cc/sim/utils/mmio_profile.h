@@ -0,0 +1,119 @@
+// See LICENSE for license details.
+
+#ifndef __MMIO_PROFILE_H
+#define __MMIO_PROFILE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <time.h>
+
+// Accounting of host <-> FPGA traffic, built with -DENABLE_MMIO_PROFILE.
+// Every transport access is charged to the phase of the host code that issued
+// it, so the summary shows which endpoint is eating host time.
+// Without the flag the macros below expand to nothing.
+
+enum mmio_phase_t {
+  MMIO_PHASE_CONTROL, // step, done, reset and anything untagged
+  MMIO_PHASE_SERIAL,
+  MMIO_PHASE_UART,
+  MMIO_PHASE_SIM_MEM,
+  MMIO_PHASE_COUNTERS,
+  MMIO_PHASE_SAMPLING,
+  MMIO_PHASE_LOADMEM,
+  MMIO_PHASE_FPGA_MODEL,
+  MMIO_PHASE_NUM
+};
+
+enum mmio_kind_t {
+  MMIO_READ,
+  MMIO_WRITE,
+  MMIO_PULL,
+  MMIO_PUSH,
+  MMIO_FLUSH, // a batch of queued reads and writes
+  MMIO_KIND_NUM
+};
+
+// Latency bucket i counts calls taking [2^i, 2^(i+1)) ns
+#define MMIO_PROFILE_BUCKETS 32
+
+struct mmio_stat_t {
+  uint64_t calls;
+  uint64_t ops;   // register accesses, or 1 per pull/push
+  uint64_t bytes;
+  uint64_t ns;
+  uint64_t hist[MMIO_PROFILE_BUCKETS];
+};
+
+class mmio_profile_t
+{
+public:
+  mmio_profile_t();
+
+  inline mmio_phase_t get_phase() const { return phase; }
+  inline void set_phase(mmio_phase_t p) { phase = p; }
+
+  inline void record(mmio_kind_t kind, size_t ops, size_t bytes, uint64_t ns) {
+    mmio_stat_t& s = stats[phase][kind];
+    size_t bucket = ns ? 63 - __builtin_clzll(ns) : 0;
+    s.calls++;
+    s.ops += ops;
+    s.bytes += bytes;
+    s.ns += ns;
+    s.hist[bucket < MMIO_PROFILE_BUCKETS ? bucket : MMIO_PROFILE_BUCKETS - 1]++;
+  }
+
+  void print(FILE* file) const;
+  bool dump_json(const char* filename) const;
+
+  static inline uint64_t now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return 1000000000ULL * ts.tv_sec + ts.tv_nsec;
+  }
+
+private:
+  mmio_phase_t phase;
+  mmio_stat_t stats[MMIO_PHASE_NUM][MMIO_KIND_NUM];
+  uint64_t percentile(const mmio_stat_t& s, double p) const;
+};
+
+extern mmio_profile_t mmio_profile;
+
+// Charges accesses in the enclosing scope to a phase
+class mmio_phase_guard_t
+{
+public:
+  mmio_phase_guard_t(mmio_phase_t phase): prev(mmio_profile.get_phase()) {
+    mmio_profile.set_phase(phase);
+  }
+  ~mmio_phase_guard_t() { mmio_profile.set_phase(prev); }
+private:
+  const mmio_phase_t prev;
+};
+
+// Times the enclosing scope as one transport call
+class mmio_op_timer_t
+{
+public:
+  mmio_op_timer_t(mmio_kind_t kind, size_t ops, size_t bytes):
+    kind(kind), ops(ops), bytes(bytes), start(mmio_profile_t::now()) { }
+  ~mmio_op_timer_t() {
+    mmio_profile.record(kind, ops, bytes, mmio_profile_t::now() - start);
+  }
+private:
+  const mmio_kind_t kind;
+  const size_t ops;
+  const size_t bytes;
+  const uint64_t start;
+};
+
+#ifdef ENABLE_MMIO_PROFILE
+#define MMIO_PROFILE_PHASE(phase) mmio_phase_guard_t __mmio_phase(phase)
+#define MMIO_PROFILE_OP(kind, ops, bytes) mmio_op_timer_t __mmio_op(kind, ops, bytes)
+#else
+#define MMIO_PROFILE_PHASE(phase)
+#define MMIO_PROFILE_OP(kind, ops, bytes)
+#endif
+
+#endif // __MMIO_PROFILE_H
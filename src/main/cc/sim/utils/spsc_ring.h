@@ -0,0 +1,97 @@
+// See LICENSE for license details.
+
+#ifndef __SPSC_RING_H
+#define __SPSC_RING_H
+
+#include <algorithm>
+#include <atomic>
+#include <stdint.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+// Lock-free single-producer single-consumer ring of trivially copyable
+// messages. A side publishes a whole batch with one store to its index and
+// only makes a futex syscall when the other side has gone to sleep, so a busy
+// exchange never enters the kernel. The layout has no pointers, so a ring
+// can live in memory shared between processes; it must start out zeroed.
+
+// Polls before a consumer sleeps on the doorbell
+#define SPSC_RING_SPINS 4096
+
+template <typename T, size_t N>
+class spsc_ring_t
+{
+public:
+  // Copies up to n messages in and returns how many fit
+  size_t push(const T* msgs, size_t n) {
+    const uint32_t h = head.load(std::memory_order_relaxed);
+    const uint32_t t = tail.load(std::memory_order_acquire);
+    n = std::min(n, N - (size_t)(h - t));
+    for (size_t i = 0 ; i < n ; i++) {
+      slots[(h + i) % N] = msgs[i];
+    }
+    if (n) {
+      head.store(h + n, std::memory_order_release);
+      ring();
+    }
+    return n;
+  }
+
+  // Copies up to n messages out and returns how many there were
+  size_t pop(T* msgs, size_t n) {
+    const uint32_t t = tail.load(std::memory_order_relaxed);
+    const uint32_t h = head.load(std::memory_order_acquire);
+    n = std::min(n, (size_t)(h - t));
+    for (size_t i = 0 ; i < n ; i++) {
+      msgs[i] = slots[(t + i) % N];
+    }
+    if (n) {
+      tail.store(t + n, std::memory_order_release);
+      ring();
+    }
+    return n;
+  }
+
+  inline bool empty() const {
+    return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+  }
+  inline bool full() const {
+    return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire) == N;
+  }
+
+  // Blocks until cond() holds, e.g. the ring becomes non-empty or non-full
+  template <typename F> void wait(F cond) {
+    for (size_t i = 0 ; i < SPSC_RING_SPINS ; i++) {
+      if (cond()) return;
+    }
+    while (true) {
+      // seq_cst pairs with ring(): either we see the update or it sees us
+      const uint32_t bell = doorbell.load();
+      sleepers.fetch_add(1);
+      if (!cond()) {
+        syscall(SYS_futex, &doorbell, FUTEX_WAIT, bell, NULL, NULL, 0);
+      }
+      sleepers.fetch_sub(1);
+      if (cond()) return;
+    }
+  }
+
+private:
+  // Indices run freely and wrap modulo 2^32; N must divide 2^32
+  alignas(64) std::atomic<uint32_t> head;
+  alignas(64) std::atomic<uint32_t> tail;
+  alignas(64) std::atomic<uint32_t> doorbell;
+  std::atomic<uint32_t> sleepers;
+  alignas(64) T slots[N];
+
+  inline void ring() {
+    doorbell.fetch_add(1);
+    if (sleepers.load()) {
+      syscall(SYS_futex, &doorbell, FUTEX_WAKE, 1 << 30, NULL, NULL, 0);
+    }
+  }
+};
+
+#endif // __SPSC_RING_H
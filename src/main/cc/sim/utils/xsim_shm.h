@@ -0,0 +1,67 @@
+// See LICENSE for license details.
+
+#ifndef __XSIM_SHM_H
+#define __XSIM_SHM_H
+
+#include "spsc_ring.h"
+#include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Shared-memory transport between the F1 driver and the XSIM co-simulation.
+// Requests and responses travel on two spsc_ring_t's in a file mapped by
+// both processes, next to a staging area for pull/push data.
+
+enum xsim_cmd_t {
+  XSIM_READ,  // response carries data
+  XSIM_WRITE, // posted, no response
+  XSIM_PULL,  // response after size bytes from addr are staged in dma
+  XSIM_PUSH,  // response once size bytes staged in dma are written to addr
+  XSIM_EXIT,  // the driver is done
+};
+
+struct xsim_msg_t {
+  uint32_t cmd;
+  uint32_t data; // nonzero in a pull/push response on failure
+  uint64_t addr;
+  uint64_t size;
+};
+
+#define XSIM_RING_SIZE 4096
+#define XSIM_DMA_SIZE (1 << 20)
+
+struct xsim_shm_t {
+  spsc_ring_t<xsim_msg_t, XSIM_RING_SIZE> req;
+  spsc_ring_t<xsim_msg_t, XSIM_RING_SIZE> resp;
+  alignas(4096) char dma[XSIM_DMA_SIZE];
+};
+
+// The driver publishes a fresh, zeroed file under path with a rename, so the
+// simulator side never sees it half-made. The simulator side waits for it,
+// maps it and unlinks it, so a later run cannot pick up a stale mapping.
+// Returns NULL on failure.
+static inline xsim_shm_t* xsim_shm_map(const char* path, bool create) {
+  int fd;
+  if (create) {
+    std::string tmp = std::string(path) + ".tmp";
+    unlink(path);
+    unlink(tmp.c_str());
+    fd = open(tmp.c_str(), O_RDWR | O_CREAT | O_EXCL, 0666);
+    if (fd < 0) return NULL;
+    if (ftruncate(fd, sizeof(xsim_shm_t)) || rename(tmp.c_str(), path)) {
+      close(fd);
+      return NULL;
+    }
+  } else {
+    while ((fd = open(path, O_RDWR)) < 0) usleep(1000);
+    unlink(path);
+  }
+  void* shm = mmap(NULL, sizeof(xsim_shm_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  return shm == MAP_FAILED ? NULL : (xsim_shm_t*)shm;
+}
+
+#endif // __XSIM_SHM_H
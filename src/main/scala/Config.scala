@@ -34,6 +34,7 @@ class SimConfig extends Config((site, here, up) => {
   case MemModelKey       => Some((p: Parameters) => new SimpleLatencyPipe()(p))
   case LLCModelKey       => None
   case FpgaMMIOSize      => BigInt(1) << 12 // 4 KB
+  case DMAWindowBits     => 12 // 4 KB
   case AXIDebugPrint     => false
   case ToggleCounterSize => None
   // DRAM Counters
@@ -15,6 +15,8 @@ import scala.collection.mutable.{ArrayBuffer, ListBuffer}
 case object MemNastiKey extends Field[NastiParameters]
 case object DMANastiKey extends Field[NastiParameters]
 case object FpgaMMIOSize extends Field[BigInt]
+// log2 of the DMA address space answered by each endpoint with a DMA port
+case object DMAWindowBits extends Field[Int]
 
 class FPGATopIO(implicit val p: Parameters) extends Bundle {
   val ctrl = Flipped(WidgetMMIO())
@@ -135,7 +137,9 @@ class FPGATop(simIoType: SimWrapperIO)(implicit p: Parameters) extends Module wi
     arb.io.master(memIoSize) <> loadMem.io.toSlaveMem
   }
 
-  val dmaPorts = new ListBuffer[NastiIO]
+  val dmaPorts = new ListBuffer[(String, NastiIO)]
+  // Endpoint status bits packed into MASTER(STATUS)
+  val endpointStatus = new ListBuffer[(String, EndpointStatus)]
 
   def createResetQueue(tReset: DecoupledIO[Bool]) = {
     // each widget should have its own reset queue
@@ -156,6 +160,7 @@ class FPGATop(simIoType: SimWrapperIO)(implicit p: Parameters) extends Module wi
     widget.reset := reset.toBool || simReset
     widget.io.hostReset := reset.toBool
     widget.io.counters <> cntrs
+    endpointStatus += (widget.getWName -> widget.io.status)
     createResetQueue(widget.io.tReset)
   }) && (simIo.endpoints foldLeft true.B){ (resetReady, endpoint) =>
     ((0 until endpoint.size) foldLeft resetReady){ (ready, i) =>
@@ -179,21 +184,52 @@ class FPGATop(simIoType: SimWrapperIO)(implicit p: Parameters) extends Module wi
         case _ =>
       }
       channels2Port(widget.io.hPort, endpoint(i)._2)
-      widget.io.dma.foreach(dma => dmaPorts += dma)
+      widget.io.dma.foreach(dma => dmaPorts += (widgetName -> dma))
+      endpointStatus += (widgetName -> widget.io.status)
       // each widget should have its own reset queue
       ready && createResetQueue(widget.io.tReset)
     }
   }
 
-  assert(dmaPorts.size <= 1)
-  if (dmaPorts.nonEmpty) {
-    dmaPorts(0) <> io.dma
+  // Endpoint i answers DMA transfers in window i
+  val dmaWindowBits = p(DMAWindowBits)
+  if (dmaPorts.size > 1) {
+    val router = Module(new NastiRouter(dmaPorts.size, addr =>
+      Cat(dmaPorts.indices.reverse map (i => (addr >> dmaWindowBits) === i.U)))(
+      p alterPartial ({ case NastiKey => p(DMANastiKey) })))
+    router.io.master <> io.dma
+    (dmaPorts zip router.io.slave) foreach { case ((_, dma), slave) => dma <> slave }
+  } else if (dmaPorts.nonEmpty) {
+    dmaPorts.head._2 <> io.dma
   } else {
     io.dma := DontCare
   }
 
+  // Bit 0 is the master's done bit, followed by (done, pending) per endpoint
+  require(2 * endpointStatus.size < io.ctrl.nastiXDataBits,
+    s"${endpointStatus.size} endpoints do not fit into the status register")
+  master.io.status := (if (endpointStatus.isEmpty) 0.U else
+    Cat(endpointStatus.reverse flatMap { case (_, status) => Seq(status.pending, status.done) }))
+
   genCtrlIO(io.ctrl, p(FpgaMMIOSize))
 
+  override def genHeader(sb: StringBuilder)(implicit channelWidth: Int) {
+    import CppGenerationUtils._
+    super.genHeader(sb)
+    sb.append("\n// Status Bits\n")
+    sb.append(genMacro("MASTER_DONE_BIT", UInt32(0)))
+    endpointStatus.zipWithIndex foreach { case ((name, _), i) =>
+      sb.append(genMacro(s"${name.toUpperCase}_DONE_BIT", UInt32(2 * i + 1)))
+      sb.append(genMacro(s"${name.toUpperCase}_PENDING_BIT", UInt32(2 * i + 2)))
+    }
+    sb.append(genMacro("STATUS_PENDING_MASK", UInt32(
+      (endpointStatus.indices foldLeft BigInt(0))((mask, i) => mask | (BigInt(1) << (2 * i + 2))))))
+    if (dmaPorts.nonEmpty) sb.append("\n// DMA Windows\n")
+    dmaPorts.zipWithIndex foreach { case ((name, _), i) =>
+      sb.append(genMacro(s"${name.toUpperCase}_DMA_ADDR", UInt64(BigInt(i) << dmaWindowBits)))
+    }
+  }
+
   val headerConsts = List(
     "CTRL_ID_BITS"   -> io.ctrl.nastiXIdBits,
     "CTRL_ADDR_BITS" -> io.ctrl.nastiXAddrBits,
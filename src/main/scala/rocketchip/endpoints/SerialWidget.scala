@@ -85,6 +85,9 @@ class SerialWidget(implicit p: Parameters) extends EndpointWidget()(p) {
   // generate memory mapped registers for control signals
   // The endpoint is "done" when tokens from the target are not available any more
   genROReg(!fire, "done")
+  io.status.done := !fire
+  // The driver only needs to act on target output
+  io.status.pending := stall
 
   genCRFile()
 }
@@ -157,6 +157,8 @@ class UARTWidget(div: Int)(implicit p: Parameters) extends EndpointWidget()(p) {
   // The endpoint is "done" when tokens from the target are not available any more
   genROReg(!tFire, "done")
   genROReg(stall, "stall")
+  io.status.done := !tFire
+  io.status.pending := txfifo.io.deq.valid
 
   genCRFile()
 }
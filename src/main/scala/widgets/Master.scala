@@ -7,13 +7,15 @@ package widgets
 import junctions._
 
 import chisel3._
-import chisel3.util.{Decoupled, Counter, log2Up}
+import chisel3.util.{Decoupled, Counter, Cat, log2Up}
 import freechips.rocketchip.config.Parameters
 
 class EmulationMasterIO(implicit p: Parameters) extends WidgetIO {
   val simReset = Output(Bool())
   val done = Input(Bool())
   val step = Decoupled(UInt(p(CtrlNastiKey).dataBits.W))
+  // Packed endpoint status bits, see FPGATop
+  val status = Input(UInt((p(CtrlNastiKey).dataBits - 1).W))
 }
 
 object Pulsify {
@@ -37,6 +39,7 @@ class EmulationMaster(implicit p: Parameters) extends Widget {
   val io = IO(new EmulationMasterIO)
   genAndAttachQueue(io.step, "STEP")
   genRORegInit(io.done && ~io.simReset, "DONE", false.B)
+  genRORegInit(Cat(io.status, io.done && ~io.simReset), "STATUS", 0.U(p(CtrlNastiKey).dataBits.W))
   Pulsify(genWORegInit(io.simReset, "SIM_RESET", false.B), pulseLength = 4)
 
   genCRFile()
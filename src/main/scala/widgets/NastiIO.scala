@@ -3,32 +3,43 @@
 package midas
 package widgets
 
-import core.{HostPort, HostPortIO}
+import core.{HostPort, HostPortIO, DMANastiKey}
 import junctions._
 
 import chisel3._
 import chisel3.util._
 import freechips.rocketchip.config.Parameters
 
+// Summarized into the master's STATUS register,
+// so the driver polls every endpoint with a single read
+class EndpointStatus extends Bundle {
+  // no tokens from the target are available
+  val done = Bool()
+  // the widget is waiting to be serviced by the driver
+  val pending = Bool()
+}
+
 abstract class EndpointWidgetIO(implicit p: Parameters) extends WidgetIO()(p) {
   def hPort: HostPortIO[Data]
   def dma: Option[NastiIO]
   val tReset = Flipped(Decoupled(Bool()))
+  val status = Output(new EndpointStatus)
 }
 
 abstract class EndpointWidget(implicit p: Parameters) extends Widget()(p) {
   override def io: EndpointWidgetIO
 }
 
-class MemModelIO(implicit p: Parameters) extends EndpointWidgetIO()(p){
+class MemModelIO(hasDma: Boolean = false)(implicit p: Parameters) extends EndpointWidgetIO()(p){
   val tNasti = Flipped(HostPort(new NastiIO, false))
   val hostMem = new NastiIO
   def hPort = tNasti
-  val dma = None
+  val dma = if (hasDma) Some(Flipped(new NastiIO()(p alterPartial ({ case NastiKey => p(DMANastiKey) })))) else None
+  override def cloneType = new MemModelIO(hasDma)(p).asInstanceOf[this.type]
 }
 
-abstract class MemModel(implicit p: Parameters) extends EndpointWidget()(p){
-  val io = IO(new MemModelIO)
+abstract class MemModel(hasDma: Boolean = false)(implicit p: Parameters) extends EndpointWidget()(p){
+  val io = IO(new MemModelIO(hasDma))
   override def genHeader(base: BigInt, sb: StringBuilder) {
     super.genHeader(base, sb)
     import CppGenerationUtils._
@@ -36,10 +47,12 @@ abstract class MemModel(implicit p: Parameters) extends EndpointWidget()(p){
   }
 }
 
-abstract class NastiWidgetBase(implicit p: Parameters) extends MemModel {
+abstract class NastiWidgetBase(hasDma: Boolean = false)(implicit p: Parameters) extends MemModel(hasDma) {
   val tNasti = io.hPort.hBits
   val tReset = io.tReset.bits
   val tFire = io.hPort.toHost.hValid && io.hPort.fromHost.hReady && io.tReset.valid
+  io.status.done := !tFire
+  io.status.pending := false.B
 
   // Buffers for NASTI(AXI) channels
   val arBuf = Module(new Queue(new NastiReadAddressChannel,   8, flow=true))
@@ -104,8 +117,20 @@ abstract class NastiWidgetBase(implicit p: Parameters) extends MemModel {
   }
 }
 
-// Widget to handle NastiIO efficiently when software memory timing models are used
-class NastiWidget(implicit val p: Parameters) extends NastiWidgetBase {
+// Widget to handle NastiIO efficiently when software memory timing models are used.
+// With a DMA channel the driver can also move a host step in two bulk
+// transfers instead of a register access per field, when its transport
+// reaches the DMA port:
+//  - every cycle the target enqueues AR, AW or W beats, a request record of
+//    them is queued in "reqQueue", and a pull drains as many records as it
+//    reads, with the ready bits of the R and B buffers in each
+//  - a push returns a response record: the bits of the "ready" register,
+//    an R beat, a B beat and the next delta
+// Either way, request beats only leave the buffers on the model's ready
+// bits, so the driver keeps track of what the buffers hold from the
+// records. Records are laid out in 64-bit words, one per DMA beat, as
+// sim_mem.h decodes them.
+class NastiWidget(implicit val p: Parameters) extends NastiWidgetBase(p(HasDMAChannel)) {
   /*** Timing information ***/
   // deltas from the simulation driver are kept in "deltaBuf"
   val deltaBuf = Module(new Queue(UInt(32.W), 2))
@@ -119,15 +144,24 @@ class NastiWidget(implicit val p: Parameters) extends NastiWidgetBase {
   val stall = !delta.orR && (readCount.orR || writeCount.orR)
   val (fire, cycles, targetReset) = elaborate(stall)
 
+  // A new request cuts a delta short, as the driver's model only granted
+  // it for the requests already made. The cycles it had left are kept in
+  // "deltaLeft" for the driver to step its model over the ones run.
+  val request = fire && (tNasti.ar.fire() || tNasti.aw.fire())
+  val deltaLeft = Reg(UInt(32.W))
+
   deltaBuf.io.deq.ready := stall
   when(reset.toBool || targetReset) {
     delta := 0.U
+    deltaLeft := 0.U
   }.elsewhen(deltaBuf.io.deq.valid && stall) {
     // consume "deltaBuf" with stall
     delta := deltaBuf.io.deq.bits
+    deltaLeft := 0.U
   }.elsewhen(fire && delta.orR) {
     // decrement delta with firing condition
-    delta := delta - 1.U
+    delta := Mux(request, 0.U, delta - 1.U)
+    when(request) { deltaLeft := delta - 1.U }
   }
 
   // Set outstanding read counts
@@ -155,8 +189,13 @@ class NastiWidget(implicit val p: Parameters) extends NastiWidgetBase {
   io.hostMem.r.ready := false.B
   io.hostMem.b.ready := false.B
 
-  // Generate memory-mapped registers for the read address channel
   val arMeta = Seq(arBuf.io.deq.bits.id, arBuf.io.deq.bits.size, arBuf.io.deq.bits.len)
+  val awMeta = Seq(awBuf.io.deq.bits.id, awBuf.io.deq.bits.size, awBuf.io.deq.bits.len)
+  val wMeta = Seq(wBuf.io.deq.bits.strb, wBuf.io.deq.bits.last)
+  val rMetaWidth = (Seq(rBuf.io.enq.bits.id, rBuf.io.enq.bits.resp, rBuf.io.enq.bits.last) foldLeft 0)(_ + _.getWidth)
+  val bMetaWidth = (Seq(bBuf.io.enq.bits.id, bBuf.io.enq.bits.resp) foldLeft 0)(_ + _.getWidth)
+
+  // Generate memory-mapped registers for the read address channel
   val arMetaWidth = (arMeta foldLeft 0)(_ + _.getWidth)
   assert(arMetaWidth <= io.ctrl.nastiXDataBits)
   if (tNasti.ar.bits.addr.getWidth + arMetaWidth <= io.ctrl.nastiXDataBits) {
@@ -167,7 +206,6 @@ class NastiWidget(implicit val p: Parameters) extends NastiWidgetBase {
   }
 
   // Generate memory-mapped registers for the write address channel
-  val awMeta = Seq(awBuf.io.deq.bits.id, awBuf.io.deq.bits.size, awBuf.io.deq.bits.len)
   val awMetaWidth = (awMeta foldLeft 0)(_ + _.getWidth)
   assert(awMetaWidth <= io.ctrl.nastiXDataBits)
   if (tNasti.aw.bits.addr.getWidth + awMetaWidth <= io.ctrl.nastiXDataBits) {
@@ -178,7 +216,6 @@ class NastiWidget(implicit val p: Parameters) extends NastiWidgetBase {
   }
 
   // Generate memory-mapped registers for the write data channel
-  val wMeta = Seq(wBuf.io.deq.bits.strb, wBuf.io.deq.bits.last)
   val wMetaWidth = (wMeta foldLeft 0)(_ + _.getWidth)
   assert(wMetaWidth <= io.ctrl.nastiXDataBits)
   genROReg(Cat(wMeta), "w_meta")
@@ -190,27 +227,17 @@ class NastiWidget(implicit val p: Parameters) extends NastiWidgetBase {
   }
 
   // Generate memory-mapped registers for the read data channel
-  val rMeta = Seq(rBuf.io.deq.bits.id, rBuf.io.deq.bits.resp, rBuf.io.deq.bits.last)
-  val rMetaWidth = (rMeta foldLeft 0)(_ + _.getWidth)
   val rMetaReg = Reg(UInt(rMetaWidth.W))
   assert(rMetaWidth <= io.ctrl.nastiXDataBits)
   attach(rMetaReg, "r_meta")
-  rBuf.io.enq.bits.id := rMetaReg >> (tNasti.r.bits.resp.getWidth + 1).U
-  rBuf.io.enq.bits.resp := rMetaReg >> 1.U
-  rBuf.io.enq.bits.last := rMetaReg(0)
   val rdataChunks = (tNasti.r.bits.nastiXDataBits - 1) / io.ctrl.nastiXDataBits + 1
   val rdataRegs = Seq.fill(rdataChunks)(Reg(UInt()))
   val rdataAddrs = rdataRegs.zipWithIndex map {case (reg, i) => attach(reg, s"r_data_$i")}
-  rBuf.io.enq.bits.data := Cat(rdataRegs.reverse)
 
   // Generate memory-mapped registers for the write response channel
-  val bMeta = Seq(bBuf.io.deq.bits.id, bBuf.io.deq.bits.resp)
-  val bMetaWidth = (bMeta foldLeft 0)(_ + _.getWidth)
   val bMetaReg = Reg(UInt(bMetaWidth.W))
   assert(bMetaWidth <= io.ctrl.nastiXDataBits)
   attach(bMetaReg, "b_meta")
-  bBuf.io.enq.bits.id := bMetaReg >> (tNasti.b.bits.resp.getWidth).U
-  bBuf.io.enq.bits.resp := bMetaReg
 
   // Generate memory-mapped registers for ready/valid
   genROReg(Cat(
@@ -220,20 +247,131 @@ class NastiWidget(implicit val p: Parameters) extends NastiWidgetBase {
     rBuf.io.enq.ready,
     bBuf.io.enq.ready), "valid")
   val readyReg = RegInit(0.U(5.W))
-  arBuf.io.deq.ready := readyReg(4)
-  awBuf.io.deq.ready := readyReg(3)
-  wBuf.io.deq.ready := readyReg(2)
-  rBuf.io.enq.valid := readyReg(1)
-  bBuf.io.enq.valid := readyReg(0)
   attach(readyReg, "ready")
   when(readyReg.orR) { readyReg := 0.U }
 
+  // Connect "deltaBuf" to the control register file
+  // Timing information is provided through this
+  val deltaSink = Wire(Decoupled(UInt(32.W)))
+  attachDecoupledSink(deltaSink, "delta")
+
+  // Beats move on the ready bits and responses written to the registers,
+  // or on those of a pushed response record
+  val ready = Wire(UInt(5.W))
+  val rMeta = Wire(UInt(rMetaWidth.W))
+  val rData = Wire(UInt(tNasti.r.bits.nastiXDataBits.W))
+  val bMeta = Wire(UInt(bMetaWidth.W))
+  arBuf.io.deq.ready := ready(4)
+  awBuf.io.deq.ready := ready(3)
+  wBuf.io.deq.ready := ready(2)
+  rBuf.io.enq.valid := ready(1)
+  bBuf.io.enq.valid := ready(0)
+  rBuf.io.enq.bits.id := rMeta >> (tNasti.r.bits.resp.getWidth + 1).U
+  rBuf.io.enq.bits.resp := rMeta >> 1.U
+  rBuf.io.enq.bits.last := rMeta(0)
+  rBuf.io.enq.bits.data := rData
+  bBuf.io.enq.bits.id := bMeta >> (tNasti.b.bits.resp.getWidth).U
+  bBuf.io.enq.bits.resp := bMeta
+
+  io.dma match {
+    case Some(dma) =>
+      val dataWords = (tNasti.w.bits.nastiXDataBits - 1) / 64 + 1
+      def words(fields: Seq[(UInt, Int)]) = Cat(fields.reverse map { case (f, n) => f.pad(64 * n) })
+
+      // Request record: AR, AW and W beats enqueued on one cycle, flagged
+      // in the bits of the "valid" register, which the pull fills in with
+      // the ready bits of the R and B buffers and "deltaLeft" in bits 63:32
+      val arIn = arBuf.io.enq.bits
+      val awIn = awBuf.io.enq.bits
+      val wIn = wBuf.io.enq.bits
+      val reqRecord = words(Seq(
+        Cat(arBuf.io.enq.fire(), awBuf.io.enq.fire(), wBuf.io.enq.fire(), 0.U(2.W)) -> 1,
+        arIn.addr -> 1, Cat(arIn.id, arIn.size, arIn.len) -> 1,
+        awIn.addr -> 1, Cat(awIn.id, awIn.size, awIn.len) -> 1,
+        Cat(wIn.strb, wIn.last) -> 1, wIn.data -> dataWords))
+      require(reqRecord.getWidth <= dma.nastiXDataBits,
+        s"NASTI request records of ${reqRecord.getWidth} bits do not fit DMA beats")
+      // Every record not yet pulled holds a beat still in the buffers, so
+      // the queue is never full when the target enqueues
+      val reqQueue = Module(new Queue(UInt(reqRecord.getWidth.W),
+        arBuf.entries + awBuf.entries + wBuf.entries))
+      reqQueue.reset := reset.toBool || targetReset
+      reqQueue.io.enq.valid := arBuf.io.enq.fire() || awBuf.io.enq.fire() || wBuf.io.enq.fire()
+      reqQueue.io.enq.bits := reqRecord
+
+      // Pulls: one burst at a time, padded with empty records once the
+      // queue runs dry
+      val pulling = RegInit(false.B)
+      val pullId = Reg(UInt(dma.nastiXIdBits.W))
+      val pullLen = Reg(UInt(dma.nastiXLenBits.W))
+      dma.ar.ready := !pulling
+      when (dma.ar.fire()) {
+        pulling := true.B
+        pullId := dma.ar.bits.id
+        pullLen := dma.ar.bits.len
+      }
+      dma.r.valid := pulling
+      dma.r.bits.id := pullId
+      dma.r.bits.data := Mux(reqQueue.io.deq.valid, reqQueue.io.deq.bits, 0.U) |
+        Cat(deltaLeft, 0.U(30.W), rBuf.io.enq.ready, bBuf.io.enq.ready)
+      dma.r.bits.last := pullLen === 0.U
+      dma.r.bits.resp := 0.U
+      dma.r.bits.user := 0.U
+      reqQueue.io.deq.ready := pulling && dma.r.ready
+      when (dma.r.fire()) {
+        pullLen := pullLen - 1.U
+        when (pullLen === 0.U) { pulling := false.B }
+      }
+
+      // Pushes: response records, taken as a write of the registers they carry
+      val pushing = RegInit(false.B)
+      val pushAck = RegInit(false.B)
+      val pushId = Reg(UInt(dma.nastiXIdBits.W))
+      dma.aw.ready := !pushing && !pushAck
+      when (dma.aw.fire()) {
+        pushing := true.B
+        pushId := dma.aw.bits.id
+      }
+      val resp = dma.w.bits.data
+      def word(i: Int, n: Int = 1) = resp(64 * (i + n) - 1, 64 * i)
+      val respReady = resp(4, 0)
+      val respDelta = resp(63, 32)
+      dma.w.ready := pushing &&
+        (!respReady(1) || rBuf.io.enq.ready) &&
+        (!respReady(0) || bBuf.io.enq.ready) &&
+        (!respDelta.orR || deltaBuf.io.enq.ready)
+      val take = dma.w.fire()
+      val takeDelta = take && respDelta.orR
+      ready := readyReg | Mux(take, respReady, 0.U)
+      rMeta := Mux(take, word(1), rMetaReg)
+      rData := Mux(take, word(3, dataWords), Cat(rdataRegs.reverse))
+      bMeta := Mux(take, word(2), bMetaReg)
+      deltaBuf.io.enq.valid := deltaSink.valid || takeDelta
+      deltaBuf.io.enq.bits := Mux(takeDelta, respDelta, deltaSink.bits)
+      deltaSink.ready := deltaBuf.io.enq.ready && !takeDelta
+      when (take && dma.w.bits.last) {
+        pushing := false.B
+        pushAck := true.B
+      }
+      dma.b.valid := pushAck
+      dma.b.bits.id := pushId
+      dma.b.bits.resp := 0.U
+      dma.b.bits.user := 0.U
+      when (dma.b.fire()) { pushAck := false.B }
+
+    case None =>
+      ready := readyReg
+      rMeta := rMetaReg
+      rData := Cat(rdataRegs.reverse)
+      bMeta := bMetaReg
+      deltaBuf.io.enq <> deltaSink
+  }
+
   // Generate memory-mapped registers for control signals
   genROReg(!tFire, "done")
   genROReg(stall && !deltaBuf.io.deq.valid, "stall")
-  // Connect "deltaBuf" to the control register file
-  // Timing information is provided through this
-  attachDecoupledSink(deltaBuf.io.enq, "delta")
+  genROReg(deltaLeft, "delta_left")
+  io.status.pending := stall && !deltaBuf.io.deq.valid
 
   genCRFile()
 
@@ -243,5 +381,7 @@ class NastiWidget(implicit val p: Parameters) extends NastiWidgetBase {
     val name = getWName.toUpperCase
     sb.append(genArray(s"${name}_w_data", wdataAddrs map (off => UInt32(base + off)))) 
     sb.append(genArray(s"${name}_r_data", rdataAddrs map (off => UInt32(base + off)))) 
+    // Lets the driver find the registers of any NastiWidget_<n> by name
+    crRegistry.genArrayHeader(name, base, sb)
   }
 }
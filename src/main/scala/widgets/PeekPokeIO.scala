@@ -114,6 +114,7 @@ class PeekPokeIOWidget(inputs: Seq[(String, Int)], outputs: Seq[(String, Int)])
     sb.append(genArray("INPUT_ADDRS", inputAddrs map (off => UInt32(base + off))))
     sb.append(genArray("INPUT_NAMES", inputs.unzip._1 map CStrLit))
     sb.append(genArray("INPUT_CHUNKS", inputs.unzip._2 map (UInt32(_))))
+    sb.append(genMacro("INPUT_MAX_CHUNKS", UInt32((inputs.unzip._2 :+ 1).max)))
 
     sb.append(genComment("Peekable target outputs"))
     sb.append(genMacro("PEEK_SIZE", UInt64(outputs.size)))
@@ -121,5 +122,6 @@ class PeekPokeIOWidget(inputs: Seq[(String, Int)], outputs: Seq[(String, Int)])
     sb.append(genArray("OUTPUT_ADDRS", outputAddrs map (off => UInt32(base + off))))
     sb.append(genArray("OUTPUT_NAMES", outputs.unzip._1 map CStrLit))
     sb.append(genArray("OUTPUT_CHUNKS", outputs.unzip._2 map (UInt32(_))))
+    sb.append(genMacro("OUTPUT_MAX_CHUNKS", UInt32((outputs.unzip._2 :+ 1).max)))
   }
 }
@@ -10,6 +10,7 @@ import midas.widgets._
 class ToggleCounterWidgetIO(size: Int)(implicit p: Parameters) extends WidgetIO {
   val counters = Flipped(Decoupled(Vec(size, UInt(32.W))))
   val tReset = Flipped(Decoupled(Bool()))
+  val status = Output(new EndpointStatus)
 }
 
 class ToggleCounterWidget(size: Int)(implicit p: Parameters) extends Widget {
@@ -40,6 +41,8 @@ class ToggleCounterWidget(size: Int)(implicit p: Parameters) extends Widget {
 
   io.tReset.ready := fire
   io.counters.ready := fire
+  io.status.done := true.B
+  io.status.pending := state === sBaud
 
   switch(state) {
     is(sRun) {